@@ -0,0 +1,714 @@
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <benchmark/benchmark.h>
+
+#include "aggregate_grid.h"
+#include "draw.h"
+#include "grid.h"
+#include "neighbor_filter.h"
+#include "quadtree.h"
+#include "simulation.h"
+#include "thread_pool.h"
+#include "trajectory.h"
+
+namespace {
+
+constexpr float kDt = 1.0f / 60;
+
+/** Interactive default is 80 boids in a 1024x768 window */
+constexpr std::int64_t kDefaultDensity = 80;
+constexpr std::int64_t kDefaultCount = 10000;
+
+const std::vector<std::int64_t> kCounts = {100, 1000, 10000, 100000, 1000000};
+/** Boids per 1024x768 area */
+const std::vector<std::int64_t> kDensities = {20, 80, 320, 1280};
+const std::vector<std::int64_t> kPredatorCounts = {0, 1, 10, 100, 1000, 10000};
+const std::vector<std::int64_t> kThreadCounts = {1, 2, 4, 8, 16, 32};
+const std::vector<std::int64_t> kHeadingModes = {
+  static_cast<std::int64_t>(HeadingMode::kAngle),
+  static_cast<std::int64_t>(HeadingMode::kVector)
+};
+
+sf::Vector2f world_size_for(std::size_t count, std::size_t density) {
+  const float kScale = std::sqrt(static_cast<float>(count) / density);
+  return sf::Vector2f(1024 * kScale, 768 * kScale);
+}
+
+/** Random flock and predators, everything a single simulation step needs */
+struct Scenario {
+  Scenario(std::size_t count, std::size_t density, std::size_t predator_count, unsigned int thread_count = 1,
+           HeadingMode heading_mode = HeadingMode::kAngle, bool periodic_boundaries = true)
+    : simulation(world_size_for(count, density), thread_count),
+      grid(Boid::cohesion_distance()) {
+    simulation.add_boids(count);
+    simulation.set_heading_mode(heading_mode);
+    simulation.set_periodic_boundaries(periodic_boundaries);
+    grid.set_periodic(periodic_boundaries);
+
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<float> random_pos_x(0, simulation.world_size().x);
+    std::uniform_real_distribution<float> random_pos_y(0, simulation.world_size().y);
+    predators.resize(predator_count);
+    for (auto& predator : predators) {
+      predator.position = sf::Vector2f(random_pos_x(gen), random_pos_y(gen));
+    }
+
+    prepare();
+  }
+
+  /** Rebuild grid, predator index and state copies from the flock */
+  void prepare() {
+    const Boids& kBoids = simulation.boids();
+    grid.build(kBoids.x(), kBoids.y(), simulation.world_size());
+    predator_index.build(predators.data(), predators.size(), Boid::predator_detection_distance(),
+                         simulation.world_size());
+    states.clear();
+    states.reserve(kBoids.size());
+    for (Boids::size_type i = 0; i < kBoids.size(); ++i) {
+      states.push_back(kBoids.state(i));
+    }
+  }
+
+  Simulation simulation;
+  Predators predators;
+  Grid grid;
+  PredatorIndex predator_index;
+  std::vector<BoidStore::State> states;
+};
+
+void set_counters(benchmark::State& state, std::size_t count) {
+  state.SetItemsProcessed(state.iterations() * count);
+}
+
+/** Full update_boids step: grid build, predators, neighbor search, rules and integration */
+void BM_UpdateBoids(benchmark::State& state) {
+  const std::size_t kCount = state.range(0);
+  Scenario scenario(kCount, state.range(1), state.range(2), state.range(3), static_cast<HeadingMode>(state.range(4)));
+  for (auto _ : state) {
+    scenario.simulation.update(scenario.predators, kDt);
+  }
+  set_counters(state, kCount);
+}
+
+/**
+ * Simulation steps with a grid search every frame or with reused Verlet lists.
+ *
+ * Steps run back to back, so Verlet lists are rebuilt as often as in a real
+ * run. The verlet_builds counter is the share of steps that rebuilt them.
+ */
+void BM_UpdateNeighborSearch(benchmark::State& state) {
+  const std::size_t kCount = state.range(0);
+  Scenario scenario(kCount, kDefaultDensity, 0);
+  scenario.simulation.set_neighbor_search(static_cast<NeighborSearch>(state.range(1)));
+  const std::size_t kBuildsBefore = scenario.simulation.verlet_build_count();
+  for (auto _ : state) {
+    scenario.simulation.update(scenario.predators, kDt);
+  }
+  set_counters(state, kCount);
+  state.counters["verlet_builds"] = benchmark::Counter(
+    static_cast<double>(scenario.simulation.verlet_build_count() - kBuildsBefore) / state.iterations());
+}
+
+void BM_GridBuild(benchmark::State& state) {
+  const std::size_t kCount = state.range(0);
+  Scenario scenario(kCount, state.range(1), 0, 1, HeadingMode::kAngle, state.range(2) != 0);
+  const Boids& kBoids = scenario.simulation.boids();
+  for (auto _ : state) {
+    scenario.grid.build(kBoids.x(), kBoids.y(), scenario.simulation.world_size());
+  }
+  set_counters(state, kCount);
+}
+
+void BM_NeighborSearch(benchmark::State& state) {
+  const std::size_t kCount = state.range(0);
+  Scenario scenario(kCount, state.range(1), 0, 1, HeadingMode::kAngle, state.range(2) != 0);
+  const Boids& kBoids = scenario.simulation.boids();
+  for (auto _ : state) {
+    for (Boids::size_type i = 0; i < kBoids.size(); ++i) {
+      benchmark::DoNotOptimize(kBoids.get_flockmates(i, scenario.states[i], scenario.grid));
+    }
+  }
+  set_counters(state, kCount);
+}
+
+/**
+ * Flock spread uniformly or collapsed into clumps, with grid and quadtree built over it.
+ *
+ * Clumps hold a few hundred boids each, so the 3x3 grid cells around a
+ * query hold many boids out of reach while most other cells are empty.
+ */
+struct ClusteredScenario {
+  ClusteredScenario(std::size_t count, bool clustered, unsigned int bucket_size)
+    : world_size(world_size_for(count, kDefaultDensity)),
+      grid(Boid::cohesion_distance()),
+      quadtree(Boid::cohesion_distance(), std::max(1u, bucket_size)) {
+    constexpr std::size_t kClumpSize = 400;
+    constexpr float kClumpRadius = 60;
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<float> random_pos_x(0, world_size.x);
+    std::uniform_real_distribution<float> random_pos_y(0, world_size.y);
+    std::normal_distribution<float> random_offset(0, kClumpRadius);
+    std::vector<sf::Vector2f> clumps(std::max<std::size_t>(1, count / kClumpSize));
+    for (auto& clump : clumps) {
+      clump = sf::Vector2f(random_pos_x(gen), random_pos_y(gen));
+    }
+
+    boids.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+      sf::Vector2f pos(random_pos_x(gen), random_pos_y(gen));
+      if (clustered) {
+        const sf::Vector2f kOffset(random_offset(gen), random_offset(gen));
+        pos = clumps[i % clumps.size()] + kOffset;
+        pos.x = std::fmod(pos.x + world_size.x, world_size.x);
+        pos.y = std::fmod(pos.y + world_size.y, world_size.y);
+      }
+      boids.push_back(pos, 0, sf::Color::White);
+    }
+
+    grid.set_periodic(true);
+    quadtree.set_periodic(true);
+    grid.build(boids.x(), boids.y(), world_size);
+    quadtree.build(boids.x(), boids.y(), world_size);
+    for (Boids::size_type i = 0; i < boids.size(); ++i) {
+      states.push_back(boids.state(i));
+    }
+  }
+
+  sf::Vector2f world_size;
+  Boids boids;
+  Grid grid;
+  Quadtree quadtree;
+  std::vector<BoidStore::State> states;
+};
+
+/**
+ * Spatial index build and flockmate search of every boid, grid or quadtree.
+ *
+ * Bucket 0 is the grid, anything else a quadtree with that leaf size. The
+ * candidates counter is the number of boids scanned per query, the neighbors
+ * counter the number of them within the cohesion distance.
+ */
+void BM_SpatialIndex(benchmark::State& state) {
+  const std::size_t kCount = state.range(0);
+  const unsigned int kBucketSize = state.range(2);
+  ClusteredScenario scenario(kCount, state.range(1) != 0, kBucketSize);
+  const auto kSearch = [&](auto& spatial_index) {
+    for (auto _ : state) {
+      spatial_index.build(scenario.boids.x(), scenario.boids.y(), scenario.world_size);
+      for (Boids::size_type i = 0; i < scenario.boids.size(); ++i) {
+        benchmark::DoNotOptimize(scenario.boids.get_flockmates(i, scenario.states[i], spatial_index));
+      }
+    }
+
+    std::size_t candidates = 0;
+    std::size_t neighbors = 0;
+    for (Boids::size_type i = 0; i < scenario.boids.size(); ++i) {
+      spatial_index.for_each_candidate_range(scenario.states[i].pos,
+                                             [&candidates](unsigned int begin, unsigned int end) {
+                                               candidates += end - begin;
+                                             });
+      neighbors += scenario.boids.get_flockmates(i, scenario.states[i], spatial_index).cohesion.count;
+    }
+    state.counters["candidates"] = benchmark::Counter(static_cast<double>(candidates) / kCount);
+    state.counters["neighbors"] = benchmark::Counter(static_cast<double>(neighbors) / kCount);
+  };
+
+  if (kBucketSize == 0) {
+    kSearch(scenario.grid);
+  } else {
+    kSearch(scenario.quadtree);
+  }
+  set_counters(state, kCount);
+}
+
+/**
+ * Flockmate search of every boid on a thread pool, one chunk per thread or stolen chunks.
+ *
+ * The first quarter of the boids shares one dense clump, like neighbors
+ * after a spatial sort, so whichever thread gets them searches far more
+ * flockmates than the others. With one chunk per thread nobody can help it,
+ * the steals counter is the number of chunk ranges stolen per search.
+ */
+void BM_ThreadPoolBalance(benchmark::State& state) {
+  const std::size_t kCount = state.range(0);
+  const bool kStealing = state.range(2) != 0;
+  const sf::Vector2f kWorldSize = world_size_for(kCount, kDefaultDensity);
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<float> random_pos_x(0, kWorldSize.x);
+  std::uniform_real_distribution<float> random_pos_y(0, kWorldSize.y);
+  std::normal_distribution<float> random_offset(0, Boid::cohesion_distance());
+  Boids boids;
+  boids.reserve(kCount);
+  for (std::size_t i = 0; i < kCount; ++i) {
+    sf::Vector2f pos(random_pos_x(gen), random_pos_y(gen));
+    if (i < kCount / 4) {
+      pos = kWorldSize / 2.0f + sf::Vector2f(random_offset(gen), random_offset(gen));
+    }
+    boids.push_back(pos, 0, sf::Color::White);
+  }
+
+  Grid grid(Boid::cohesion_distance());
+  grid.set_periodic(true);
+  grid.build(boids.x(), boids.y(), kWorldSize);
+  std::vector<BoidStore::State> states;
+  for (Boids::size_type i = 0; i < boids.size(); ++i) {
+    states.push_back(boids.state(i));
+  }
+
+  ThreadPool thread_pool(state.range(1));
+  const std::size_t kChunkSize = kStealing ? 0 : (kCount + thread_pool.thread_count() - 1) / thread_pool.thread_count();
+  thread_pool.take_stats();
+  for (auto _ : state) {
+    thread_pool.parallel_for(kCount, [&](std::size_t begin, std::size_t end) {
+      for (std::size_t i = begin; i < end; ++i) {
+        benchmark::DoNotOptimize(boids.get_flockmates(i, states[i], grid));
+      }
+    }, kChunkSize);
+  }
+
+  std::uint64_t steals = 0;
+  for (const auto& kWorker : thread_pool.take_stats().workers) {
+    steals += kWorker.steal_count;
+  }
+  state.counters["steals"] = benchmark::Counter(static_cast<double>(steals) / state.iterations());
+  set_counters(state, kCount);
+}
+
+/**
+ * Flockmate search of every boid in clumps of growing density, metric or topological.
+ *
+ * All boids share one clump, so flockmates within reach grow with the
+ * density. Metric search sums all of them, topological search keeps the k
+ * nearest, and in the quadtree it skips leaves beyond the farthest of them.
+ * Bucket 0 is the grid, anything else a quadtree with that leaf size.
+ */
+void BM_TopologicalNeighbors(benchmark::State& state) {
+  constexpr std::size_t kCount = 10000;
+  const float kClumpRadius = state.range(0);
+  const unsigned int kNeighborCount = state.range(1);
+  const unsigned int kBucketSize = state.range(2);
+  const sf::Vector2f kWorldSize = world_size_for(kCount, kDefaultDensity);
+  std::mt19937 gen(42);
+  std::normal_distribution<float> random_offset(0, kClumpRadius);
+  Boids boids;
+  for (std::size_t i = 0; i < kCount; ++i) {
+    const sf::Vector2f kOffset(random_offset(gen), random_offset(gen));
+    const sf::Vector2f kPos = kWorldSize / 2.0f + kOffset;
+    boids.push_back(sf::Vector2f(std::fmod(kPos.x + kWorldSize.x, kWorldSize.x),
+                                 std::fmod(kPos.y + kWorldSize.y, kWorldSize.y)), 0, sf::Color::White);
+  }
+  boids.set_topological_neighbor_count(kNeighborCount);
+  std::vector<BoidStore::State> states;
+  for (Boids::size_type i = 0; i < boids.size(); ++i) {
+    states.push_back(boids.state(i));
+  }
+
+  const auto kSearch = [&](auto& spatial_index) {
+    spatial_index.set_periodic(true);
+    spatial_index.build(boids.x(), boids.y(), kWorldSize);
+    for (auto _ : state) {
+      for (Boids::size_type i = 0; i < boids.size(); ++i) {
+        benchmark::DoNotOptimize(boids.get_flockmates(i, states[i], spatial_index));
+      }
+    }
+
+    std::size_t neighbors = 0;
+    for (Boids::size_type i = 0; i < boids.size(); ++i) {
+      neighbors += boids.get_flockmates(i, states[i], spatial_index).cohesion.count;
+    }
+    state.counters["neighbors"] = benchmark::Counter(static_cast<double>(neighbors) / kCount);
+  };
+
+  if (kBucketSize == 0) {
+    Grid grid(Boid::cohesion_distance());
+    kSearch(grid);
+  } else {
+    Quadtree quadtree(Boid::cohesion_distance(), kBucketSize);
+    kSearch(quadtree);
+  }
+  set_counters(state, kCount);
+}
+
+/**
+ * Flockmate search of every boid with the grid or with cell sums of an aggregate grid.
+ *
+ * Subdivisions 0 is the exact grid search, anything else an aggregate grid
+ * with that many cells per cohesion distance. Cells within a rule distance
+ * hold only flockmates, so the sums differ from the exact ones by rounding
+ * only: the cohesion_error counter is the largest distance between the
+ * centers of mass in pixels, the alignment_error counter the largest angle
+ * between the mean headings in degrees and count_errors the flockmate
+ * counts that differ.
+ */
+void BM_CellAggregates(benchmark::State& state) {
+  const std::size_t kCount = state.range(0);
+  const int kSubdivisions = state.range(2);
+  Scenario scenario(kCount, state.range(1), 0);
+  const Boids& kBoids = scenario.simulation.boids();
+  std::vector<float> sin;
+  std::vector<float> cos;
+  kBoids.headings(sin, cos);
+  AggregateGrid aggregate_grid(Boid::cohesion_distance(), std::max(1, kSubdivisions));
+  aggregate_grid.set_periodic(true);
+  aggregate_grid.build(kBoids.x(), kBoids.y(), sin, cos, scenario.simulation.world_size());
+
+  const auto kSearch = [&](const auto& spatial_index) {
+    for (auto _ : state) {
+      for (Boids::size_type i = 0; i < kBoids.size(); ++i) {
+        benchmark::DoNotOptimize(kBoids.get_flockmates(i, scenario.states[i], spatial_index));
+      }
+    }
+  };
+
+  if (kSubdivisions == 0) {
+    kSearch(scenario.grid);
+  } else {
+    kSearch(aggregate_grid);
+  }
+  set_counters(state, kCount);
+
+  double cohesion_error = 0;
+  double alignment_error = 0;
+  std::size_t count_errors = 0;
+  for (Boids::size_type i = 0; i < kBoids.size(); ++i) {
+    const BoidStore::Flockmates kExact = kBoids.get_flockmates(i, scenario.states[i], scenario.grid);
+    const BoidStore::Flockmates kApproximate = kBoids.get_flockmates(i, scenario.states[i], aggregate_grid);
+    count_errors += kExact.cohesion.count != kApproximate.cohesion.count;
+    count_errors += kExact.alignment.count != kApproximate.alignment.count;
+    count_errors += kExact.separation.count != kApproximate.separation.count;
+
+    const sf::Vector2f kDelta = kExact.cohesion.center_of_mass() - kApproximate.cohesion.center_of_mass();
+    cohesion_error = std::max<double>(cohesion_error, std::hypot(kDelta.x, kDelta.y));
+    const double kExactAngle = std::atan2(kExact.alignment.sin_sum, kExact.alignment.cos_sum);
+    const double kApproximateAngle = std::atan2(kApproximate.alignment.sin_sum, kApproximate.alignment.cos_sum);
+    const double kAngle = std::abs(std::remainder(kExactAngle - kApproximateAngle, 2 * M_PI));
+    alignment_error = std::max(alignment_error, kAngle * 180 / M_PI);
+  }
+  state.counters["cohesion_error"] = benchmark::Counter(cohesion_error);
+  state.counters["alignment_error"] = benchmark::Counter(alignment_error);
+  state.counters["count_errors"] = benchmark::Counter(static_cast<double>(count_errors));
+}
+
+/** Adding and removing a batch of boids like the +/- keys, in a flock of the given size */
+void BM_AddRemoveBoids(benchmark::State& state) {
+  const std::size_t kCount = state.range(0);
+  const unsigned int kBatch = state.range(1);
+  Scenario scenario(kCount, kDefaultDensity, 0);
+  for (auto _ : state) {
+    scenario.simulation.add_boids(kBatch);
+    scenario.simulation.remove_boids(kBatch);
+  }
+  state.SetItemsProcessed(state.iterations() * kBatch * 2);
+}
+
+/** Removing boids by handle, each removal moves the last boid into the hole */
+void BM_RemoveBoidByHandle(benchmark::State& state) {
+  const std::size_t kCount = state.range(0);
+  Scenario scenario(kCount, kDefaultDensity, 0);
+  std::mt19937 gen(42);
+  for (auto _ : state) {
+    const Boids& kBoids = scenario.simulation.boids();
+    const BoidHandle kHandle = kBoids.handle(gen() % kBoids.size());
+    scenario.simulation.remove_boid(kHandle);
+    state.PauseTiming();
+    scenario.simulation.add_boids(1);
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+/**
+ * Neighbor search over boids in insertion order or reordered along a Z-order curve.
+ *
+ * Insertion order is random in space. Run with
+ * --benchmark_perf_counters=L2_RQSTS:MISS (Google Benchmark built with libpfm,
+ * Intel event name) to see the cache miss difference, not only the time.
+ */
+void BM_NeighborSearchOrder(benchmark::State& state) {
+  const std::size_t kCount = state.range(0);
+  Scenario scenario(kCount, kDefaultDensity, 0);
+  if (state.range(1) != 0) {
+    scenario.simulation.sort_spatially();
+    scenario.prepare();
+  }
+
+  const Boids& kBoids = scenario.simulation.boids();
+  for (auto _ : state) {
+    for (Boids::size_type i = 0; i < kBoids.size(); ++i) {
+      benchmark::DoNotOptimize(kBoids.get_flockmates(i, scenario.states[i], scenario.grid));
+    }
+  }
+  set_counters(state, kCount);
+}
+
+void BM_SpatialSort(benchmark::State& state) {
+  const std::size_t kCount = state.range(0);
+  Scenario scenario(kCount, kDefaultDensity, 0);
+  for (auto _ : state) {
+    scenario.simulation.sort_spatially();
+  }
+  set_counters(state, kCount);
+}
+
+/** Distance filter kernel alone, on full blocks of candidates around the query */
+void BM_NeighborFilter(benchmark::State& state) {
+  const SimdLevel kLevel = static_cast<SimdLevel>(state.range(0));
+  const NeighborFilter kFilter = get_neighbor_filter(kLevel);
+  state.SetLabel(to_string(std::min(kLevel, detect_simd_level())));
+
+  const float kCohesionDistance = Boid::cohesion_distance();
+  const float kAlignmentDistance = Boid::alignment_distance();
+  const float kSeparationDistance = Boid::separation_distance();
+  const NeighborRadii kRadii = {
+    kCohesionDistance * kCohesionDistance,
+    kAlignmentDistance * kAlignmentDistance,
+    kSeparationDistance * kSeparationDistance
+  };
+
+  /** Candidates spread over the 3x3 cells around the query like in a grid query */
+  constexpr std::size_t kCandidateCount = 64 * kNeighborFilterBlockSize;
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<float> random_coordinate(-1.5f * kCohesionDistance, 1.5f * kCohesionDistance);
+  std::vector<float> x(kCandidateCount);
+  std::vector<float> y(kCandidateCount);
+  for (std::size_t i = 0; i < kCandidateCount; ++i) {
+    x[i] = random_coordinate(gen);
+    y[i] = random_coordinate(gen);
+  }
+
+  for (auto _ : state) {
+    for (std::size_t block = 0; block < kCandidateCount; block += kNeighborFilterBlockSize) {
+      benchmark::DoNotOptimize(kFilter(&x[block], &y[block], kNeighborFilterBlockSize, 0, 0, kRadii));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kCandidateCount);
+}
+
+void BM_RuleEvaluation(benchmark::State& state) {
+  const std::size_t kCount = state.range(0);
+  Scenario scenario(kCount, kDefaultDensity, 0, 1, static_cast<HeadingMode>(state.range(1)));
+  const Boids& kBoids = scenario.simulation.boids();
+  std::vector<BoidStore::Flockmates> flockmates;
+  flockmates.reserve(kCount);
+  for (Boids::size_type i = 0; i < kBoids.size(); ++i) {
+    flockmates.push_back(kBoids.get_flockmates(i, scenario.states[i], scenario.grid));
+  }
+
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < kCount; ++i) {
+      BoidStore::State boid = scenario.states[i];
+      kBoids.apply_flocking_rules(boid, flockmates[i], kDt);
+      benchmark::DoNotOptimize(boid);
+    }
+  }
+  set_counters(state, kCount);
+}
+
+void BM_PositionIntegration(benchmark::State& state) {
+  const std::size_t kCount = state.range(0);
+  Scenario scenario(kCount, kDefaultDensity, 0, 1, static_cast<HeadingMode>(state.range(1)));
+  const Boids& kBoids = scenario.simulation.boids();
+  const sf::Vector2f kWorldSize = scenario.simulation.world_size();
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < kCount; ++i) {
+      BoidStore::State boid = scenario.states[i];
+      kBoids.integrate(boid, kDt, kWorldSize);
+      benchmark::DoNotOptimize(boid);
+    }
+  }
+  set_counters(state, kCount);
+}
+
+void BM_PredatorHandling(benchmark::State& state) {
+  const std::size_t kCount = state.range(0);
+  Scenario scenario(kCount, kDefaultDensity, state.range(1), 1, static_cast<HeadingMode>(state.range(2)));
+  const Boids& kBoids = scenario.simulation.boids();
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < kCount; ++i) {
+      BoidStore::State boid = scenario.states[i];
+      benchmark::DoNotOptimize(kBoids.handle_predators(boid, scenario.predator_index, kDt));
+    }
+  }
+  set_counters(state, kCount);
+}
+
+/**
+ * Simulation steps with autonomous predators chasing the flocks.
+ *
+ * Predators move towards the center of mass of the boids around them and
+ * boids look predators up in the predator index, so neither side scans the
+ * whole other side.
+ */
+void BM_AutonomousPredators(benchmark::State& state) {
+  const std::size_t kCount = state.range(0);
+  Scenario scenario(kCount, kDefaultDensity, 0);
+  scenario.simulation.add_predators(scenario.predators, state.range(1));
+  for (auto _ : state) {
+    scenario.simulation.update(scenario.predators, kDt);
+  }
+  set_counters(state, kCount);
+}
+
+/**
+ * Recording a few consecutive steps of the flock to a trajectory file.
+ *
+ * Includes quantizing on the calling thread and encoding and writing on
+ * the background thread, the queue fits all frames so none are dropped.
+ */
+void BM_TrajectoryRecord(benchmark::State& state) {
+  constexpr unsigned int kFrameCount = 16;
+  const std::size_t kCount = state.range(0);
+  Scenario scenario(kCount, kDefaultDensity, 0);
+  std::vector<Boids> frames;
+  for (unsigned int i = 0; i < kFrameCount; ++i) {
+    scenario.simulation.update(scenario.predators, kDt);
+    frames.push_back(scenario.simulation.boids());
+  }
+
+  const std::string kPath = "boids_bench.traj";
+  TrajectoryRecorder::Stats stats;
+  for (auto _ : state) {
+    TrajectoryRecorder recorder(kPath, kDt, kFrameCount, kFrameCount);
+    for (const Boids& kFrame : frames) {
+      recorder.record(kFrame, scenario.simulation.world_size());
+    }
+    recorder.close();
+    stats = recorder.stats();
+  }
+  std::remove(kPath.c_str());
+
+  set_counters(state, kCount * kFrameCount);
+  state.counters["bytes_per_boid"] = static_cast<double>(stats.bytes_written) / stats.boid_frame_count;
+}
+
+/** CPU side of draw_boids: filling the batched vertex array, without the draw call */
+void BM_VertexGeneration(benchmark::State& state) {
+  const std::size_t kCount = state.range(0);
+  Scenario scenario(kCount, kDefaultDensity, 0, 1, static_cast<HeadingMode>(state.range(1)));
+  sf::VertexArray vertices(sf::Triangles);
+  BoidInterpolation interpolation;
+  interpolation.alpha = 0.5f;
+  interpolation.world_size = scenario.simulation.world_size();
+  for (auto _ : state) {
+    fill_boid_vertices(scenario.simulation.boids(), interpolation, false, vertices);
+    benchmark::DoNotOptimize(&vertices[0]);
+  }
+  set_counters(state, kCount);
+}
+
+void count_density_args(benchmark::internal::Benchmark* benchmark) {
+  benchmark->ArgNames({"boids", "density", "periodic"});
+  for (const auto kCount : kCounts) {
+    benchmark->Args({kCount, kDefaultDensity, 1});
+  }
+  /** Default count at default density is already part of the count series */
+  for (const auto kDensity : kDensities) {
+    if (kDensity != kDefaultDensity) {
+      benchmark->Args({kDefaultCount, kDensity, 1});
+    }
+  }
+  benchmark->Args({kDefaultCount, kDefaultDensity, 0});
+}
+
+/** Count series in both heading modes */
+void count_heading_args(benchmark::internal::Benchmark* benchmark) {
+  benchmark->ArgNames({"boids", "heading"});
+  for (const auto kHeadingMode : kHeadingModes) {
+    for (const auto kCount : kCounts) {
+      benchmark->Args({kCount, kHeadingMode});
+    }
+  }
+}
+
+void predator_args(benchmark::internal::Benchmark* benchmark) {
+  benchmark->ArgNames({"boids", "predators", "heading"});
+  for (const auto kHeadingMode : kHeadingModes) {
+    for (const auto kPredatorCount : kPredatorCounts) {
+      benchmark->Args({kDefaultCount, kPredatorCount, kHeadingMode});
+    }
+  }
+}
+
+void update_args(benchmark::internal::Benchmark* benchmark) {
+  constexpr std::int64_t kAngle = static_cast<std::int64_t>(HeadingMode::kAngle);
+  benchmark->ArgNames({"boids", "density", "predators", "threads", "heading"});
+  for (const auto kCount : kCounts) {
+    benchmark->Args({kCount, kDefaultDensity, 1, 1, kAngle});
+  }
+  for (const auto kDensity : kDensities) {
+    if (kDensity != kDefaultDensity) {
+      benchmark->Args({kDefaultCount, kDensity, 1, 1, kAngle});
+    }
+  }
+  for (const auto kPredatorCount : kPredatorCounts) {
+    if (kPredatorCount != 1) {
+      benchmark->Args({kDefaultCount, kDefaultDensity, kPredatorCount, 1, kAngle});
+    }
+  }
+  for (const auto kThreadCount : kThreadCounts) {
+    if (kThreadCount != 1) {
+      benchmark->Args({100000, kDefaultDensity, 1, kThreadCount, kAngle});
+    }
+  }
+  for (const auto kHeadingMode : kHeadingModes) {
+    if (kHeadingMode != kAngle) {
+      benchmark->Args({kDefaultCount, kDefaultDensity, 1, 1, kHeadingMode});
+    }
+  }
+}
+
+}
+
+BENCHMARK(BM_UpdateBoids)->Apply(update_args)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_UpdateNeighborSearch)
+  ->ArgNames({"boids", "search"})
+  ->ArgsProduct({{10000, 100000}, {static_cast<std::int64_t>(NeighborSearch::kGrid),
+                                   static_cast<std::int64_t>(NeighborSearch::kVerletList)}})
+  ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_GridBuild)->Apply(count_density_args)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_NeighborSearch)->Apply(count_density_args)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_SpatialIndex)
+  ->ArgNames({"boids", "clustered", "bucket"})
+  ->ArgsProduct({{10000, 100000}, {0, 1}, {0, 16, 32, 64}})
+  ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ThreadPoolBalance)
+  ->ArgNames({"boids", "threads", "stealing"})
+  ->ArgsProduct({{20000}, {1, 2, 4, 8}, {0, 1}})
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime();
+BENCHMARK(BM_TopologicalNeighbors)
+  ->ArgNames({"clump_radius", "k", "bucket"})
+  ->ArgsProduct({{800, 200, 50}, {0, 7}, {0, 16}})
+  ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_CellAggregates)
+  ->ArgNames({"boids", "density", "subdivisions"})
+  ->ArgsProduct({{10000}, {80, 1280, 5120, 20480}, {0, 2, 5, 8}})
+  ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_AddRemoveBoids)->ArgNames({"boids", "batch"})->ArgsProduct({kCounts, {10}});
+BENCHMARK(BM_RemoveBoidByHandle)->ArgName("boids")->RangeMultiplier(10)->Range(100, 1000000);
+BENCHMARK(BM_NeighborSearchOrder)
+  ->ArgNames({"boids", "sorted"})
+  ->ArgsProduct({{100000, 1000000}, {0, 1}})
+  ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SpatialSort)->ArgName("boids")->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_NeighborFilter)
+  ->ArgName("simd")
+  ->DenseRange(static_cast<int>(SimdLevel::kScalar), static_cast<int>(SimdLevel::kAvx512));
+BENCHMARK(BM_RuleEvaluation)->Apply(count_heading_args)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_PositionIntegration)->Apply(count_heading_args);
+BENCHMARK(BM_PredatorHandling)->Apply(predator_args)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_AutonomousPredators)
+  ->ArgNames({"boids", "predators"})
+  ->ArgsProduct({{10000, 100000}, {10, 100, 1000, 10000}})
+  ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_TrajectoryRecord)
+  ->ArgName("boids")
+  ->RangeMultiplier(10)
+  ->Range(1000, 100000)
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime();
+BENCHMARK(BM_VertexGeneration)->Apply(count_heading_args);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,185 @@
+#include "aggregate_grid.h"
+
+AggregateGrid::AggregateGrid(float radius, int subdivisions)
+  : radius_(radius),
+    subdivisions_(std::max(1, subdivisions)) {}
+
+bool AggregateGrid::periodic() const {
+  return periodic_;
+}
+
+void AggregateGrid::set_periodic(bool periodic) {
+  periodic_ = periodic;
+}
+
+float AggregateGrid::radius() const {
+  return radius_;
+}
+
+void AggregateGrid::set_radius(float radius) {
+  radius_ = radius;
+}
+
+int AggregateGrid::subdivisions() const {
+  return subdivisions_;
+}
+
+void AggregateGrid::set_subdivisions(int subdivisions) {
+  subdivisions_ = std::max(1, subdivisions);
+}
+
+int AggregateGrid::columns() const {
+  return columns_;
+}
+
+int AggregateGrid::rows() const {
+  return rows_;
+}
+
+std::size_t AggregateGrid::ghost_count() const {
+  return ghost_cell_.size();
+}
+
+const std::vector<float>& AggregateGrid::sorted_x() const {
+  return x_;
+}
+
+const std::vector<float>& AggregateGrid::sorted_y() const {
+  return y_;
+}
+
+const std::vector<unsigned int>& AggregateGrid::sorted_indices() const {
+  return indices_;
+}
+
+void AggregateGrid::build(const std::vector<float>& x, const std::vector<float>& y, const std::vector<float>& sin,
+                          const std::vector<float>& cos, const sf::Vector2f& world_size) {
+  resize(world_size);
+  cell_of_.resize(x.size());
+  for (std::size_t i = 0; i < x.size(); ++i) {
+    cell_of_[i] = padded_cell_index(column(x[i]), row(y[i]));
+  }
+  add_ghosts(x, y, world_size);
+  sort_into_cells(x, y, sin, cos);
+}
+
+void AggregateGrid::resize(const sf::Vector2f& world_size) {
+  /** Whole cells per axis, so the ghost ring lines up with the opposite border when wrapping */
+  const float kCellSize = radius_ / subdivisions_;
+  columns_ = std::max(1, static_cast<int>(world_size.x / kCellSize));
+  rows_ = std::max(1, static_cast<int>(world_size.y / kCellSize));
+  cell_width_ = std::max(kCellSize, world_size.x / columns_);
+  cell_height_ = std::max(kCellSize, world_size.y / rows_);
+}
+
+void AggregateGrid::add_ghosts(const std::vector<float>& x, const std::vector<float>& y,
+                               const sf::Vector2f& world_size) {
+  ghost_cell_.clear();
+  ghost_index_.clear();
+  ghost_x_.clear();
+  ghost_y_.clear();
+  if (!periodic_) {
+    return;
+  }
+
+  const auto kAddGhost = [this](std::size_t index, int column, int row, float ghost_x, float ghost_y) {
+    ghost_cell_.push_back(padded_cell_index(column, row));
+    ghost_index_.push_back(index);
+    ghost_x_.push_back(ghost_x);
+    ghost_y_.push_back(ghost_y);
+  };
+
+  /** In a world narrower than two radii the ghosts on both sides would hold the same boids twice, like in the grid */
+  const bool kWrapX = columns_ >= 2 * subdivisions_;
+  const bool kWrapY = rows_ >= 2 * subdivisions_;
+  for (std::size_t i = 0; i < x.size(); ++i) {
+    const int kColumn = column(x[i]);
+    const int kRow = row(y[i]);
+
+    int ghost_column = kColumn;
+    float ghost_x = x[i];
+    if (kWrapX && kColumn < subdivisions_) {
+      ghost_column += columns_;
+      ghost_x += world_size.x;
+    } else if (kWrapX && kColumn >= columns_ - subdivisions_) {
+      ghost_column -= columns_;
+      ghost_x -= world_size.x;
+    }
+
+    int ghost_row = kRow;
+    float ghost_y = y[i];
+    if (kWrapY && kRow < subdivisions_) {
+      ghost_row += rows_;
+      ghost_y += world_size.y;
+    } else if (kWrapY && kRow >= rows_ - subdivisions_) {
+      ghost_row -= rows_;
+      ghost_y -= world_size.y;
+    }
+
+    if (ghost_column != kColumn) {
+      kAddGhost(i, ghost_column, kRow, ghost_x, y[i]);
+    }
+
+    if (ghost_row != kRow) {
+      kAddGhost(i, kColumn, ghost_row, x[i], ghost_y);
+    }
+
+    /** Boids near a corner are seen from the diagonally opposite corner too */
+    if (ghost_column != kColumn && ghost_row != kRow) {
+      kAddGhost(i, ghost_column, ghost_row, ghost_x, ghost_y);
+    }
+  }
+}
+
+void AggregateGrid::sort_into_cells(const std::vector<float>& x, const std::vector<float>& y,
+                                    const std::vector<float>& sin, const std::vector<float>& cos) {
+  /** Counting sort like in the grid, summing up every cell on the way */
+  const std::size_t kCellCount = (columns_ + 2 * subdivisions_) * (rows_ + 2 * subdivisions_);
+  cell_start_.assign(kCellCount + 1, 0);
+  aggregates_.assign(kCellCount, Aggregate());
+  for (const unsigned int kCell : cell_of_) {
+    ++cell_start_[kCell + 1];
+  }
+
+  for (const unsigned int kCell : ghost_cell_) {
+    ++cell_start_[kCell + 1];
+  }
+
+  for (std::size_t i = 1; i < cell_start_.size(); ++i) {
+    cell_start_[i] += cell_start_[i - 1];
+  }
+
+  const auto kAdd = [this](unsigned int cell, std::size_t boid, float boid_x, float boid_y, float boid_sin,
+                           float boid_cos) {
+    /** cell_start_[cell] is used as insertion cursor and ends up at the start of the next cell */
+    const unsigned int kSorted = cell_start_[cell]++;
+    indices_[kSorted] = boid;
+    x_[kSorted] = boid_x;
+    y_[kSorted] = boid_y;
+
+    Aggregate& aggregate = aggregates_[cell];
+    ++aggregate.count;
+    aggregate.position_sum += sf::Vector2f(boid_x, boid_y);
+    aggregate.sin_sum += boid_sin;
+    aggregate.cos_sum += boid_cos;
+  };
+
+  const std::size_t kCount = cell_of_.size() + ghost_cell_.size();
+  indices_.resize(kCount);
+  x_.resize(kCount);
+  y_.resize(kCount);
+  for (std::size_t i = 0; i < cell_of_.size(); ++i) {
+    kAdd(cell_of_[i], i, x[i], y[i], sin[i], cos[i]);
+  }
+
+  for (std::size_t i = 0; i < ghost_cell_.size(); ++i) {
+    const unsigned int kBoid = ghost_index_[i];
+    kAdd(ghost_cell_[i], kBoid, ghost_x_[i], ghost_y_[i], sin[kBoid], cos[kBoid]);
+  }
+
+  /** Shift the cursors back so every cell starts where the previous one begins */
+  for (std::size_t i = cell_start_.size() - 1; i > 0; --i) {
+    cell_start_[i] = cell_start_[i - 1];
+  }
+  cell_start_[0] = 0;
+}
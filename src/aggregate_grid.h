@@ -0,0 +1,232 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <SFML/System/Vector2.hpp>
+
+/**
+ * Fine uniform grid whose cells keep sums over their boids.
+ *
+ * The cohesion distance is ten times the separation distance, so cohesion
+ * flockmates are by far the most. Cells here are a fraction of the query
+ * radius wide and keep the count, position sum and heading sums of their
+ * boids, so a query can take a cell entirely inside a rule distance as one
+ * aggregate, in the spirit of Barnes-Hut, and only scans the boids of cells
+ * cut by it. A cell inside a distance holds only boids within it, so the
+ * sums match a boid by boid search up to rounding.
+ *
+ * Periodic boundaries work like in the grid, with a ghost ring as many cells
+ * wide as the query radius takes.
+ */
+class AggregateGrid {
+ public:
+  /** Sums over the boids of a cell, ghost copies included */
+  struct Aggregate {
+    int count = 0;
+    sf::Vector2f position_sum;
+    float sin_sum = 0;
+    float cos_sum = 0;
+  };
+
+  /** Cell around a query position, see for_each_cell() */
+  struct Cell {
+    /** Padded cell index, for aggregate() */
+    unsigned int index;
+    /** Range of the cell's boids in the sorted arrays */
+    unsigned int begin;
+    unsigned int end;
+    /** Squared distances from the query position to the nearest and the farthest point of the cell */
+    float min_distance_squared;
+    float max_distance_squared;
+  };
+
+  /**
+   * Create aggregate grid.
+   *
+   * \param radius Query radius, the largest radius that will be queried.
+   * \param subdivisions Cells per query radius, at least 1.
+   */
+  explicit AggregateGrid(float radius, int subdivisions = 5);
+
+  bool periodic() const;
+
+  /**
+   * Enable periodic boundaries, takes effect on the next build().
+   *
+   * \param periodic True if queries should wrap around the world edges.
+   */
+  void set_periodic(bool periodic);
+
+  float radius() const;
+
+  /**
+   * Set query radius, takes effect on the next build().
+   *
+   * \param radius Query radius.
+   */
+  void set_radius(float radius);
+
+  int subdivisions() const;
+
+  /**
+   * Set cells per query radius, takes effect on the next build().
+   *
+   * Finer cells leave fewer boids to scan on the edge of a radius but take
+   * more cells to visit.
+   *
+   * \param subdivisions Cells per query radius, at least 1.
+   */
+  void set_subdivisions(int subdivisions);
+
+  /**
+   * Rebuild grid and cell sums.
+   *
+   * \param x X coordinates of all boids.
+   * \param y Y coordinates of all boids.
+   * \param sin Sine of the heading of all boids, like in the alignment sums.
+   * \param cos Cosine of the heading of all boids.
+   * \param world_size World size.
+   */
+  void build(const std::vector<float>& x, const std::vector<float>& y, const std::vector<float>& sin,
+             const std::vector<float>& cos, const sf::Vector2f& world_size);
+
+  /**
+   * Call f with every non-empty cell within radius() of position.
+   *
+   * Cells come row by row, so cells next to each other in a row are next to
+   * each other in the sorted arrays too.
+   *
+   * \param position Query position.
+   * \param f Callable taking a const Cell&.
+   */
+  template<class F>
+  void for_each_cell(const sf::Vector2f& position, F&& f) const {
+    const float kRadiusSquared = radius_ * radius_;
+    const int kColumn = column(position.x);
+    const int kRow = row(position.y);
+    const int kPaddedColumns = columns_ + 2 * subdivisions_;
+    for (int r = kRow - subdivisions_; r <= kRow + subdivisions_; ++r) {
+      const float kMinY = r * cell_height_;
+      const float kMaxY = kMinY + cell_height_;
+      const float kNearY = std::max(std::max(kMinY - position.y, position.y - kMaxY), 0.0f);
+      const float kFarY = std::max(position.y - kMinY, kMaxY - position.y);
+      if (kNearY >= radius_) {
+        continue;
+      }
+
+      /** Only columns reaching into the circle on this row */
+      const float kHalfWidth = std::sqrt(kRadiusSquared - kNearY * kNearY);
+      const int kFirstColumn =
+        std::max(kColumn - subdivisions_, static_cast<int>(std::floor((position.x - kHalfWidth) / cell_width_)));
+      const int kLastColumn =
+        std::min(kColumn + subdivisions_, static_cast<int>(std::floor((position.x + kHalfWidth) / cell_width_)));
+      const int kRowStart = (r + subdivisions_) * kPaddedColumns + subdivisions_;
+      for (int c = kFirstColumn; c <= kLastColumn; ++c) {
+        const unsigned int kIndex = kRowStart + c;
+        const unsigned int kBegin = cell_start_[kIndex];
+        const unsigned int kEnd = cell_start_[kIndex + 1];
+        if (kBegin == kEnd) {
+          continue;
+        }
+
+        const float kMinX = c * cell_width_;
+        const float kMaxX = kMinX + cell_width_;
+        const float kNearX = std::max(std::max(kMinX - position.x, position.x - kMaxX), 0.0f);
+        const float kFarX = std::max(position.x - kMinX, kMaxX - position.x);
+        const float kMinDistanceSquared = kNearX * kNearX + kNearY * kNearY;
+        if (kMinDistanceSquared >= kRadiusSquared) {
+          continue;
+        }
+        f(Cell{kIndex, kBegin, kEnd, kMinDistanceSquared, kFarX * kFarX + kFarY * kFarY});
+      }
+    }
+  }
+
+  /**
+   * Call f with every range of sorted boids in the cells within radius() of position.
+   *
+   * Same interface as Grid::for_each_candidate_range(), one range per row.
+   *
+   * \param position Query position.
+   * \param f Callable taking begin and end of a range.
+   */
+  template<class F>
+  void for_each_candidate_range(const sf::Vector2f& position, F&& f) const {
+    const int kColumn = column(position.x) + subdivisions_;
+    const int kRow = row(position.y) + subdivisions_;
+    const int kPaddedColumns = columns_ + 2 * subdivisions_;
+    for (int r = kRow - subdivisions_; r <= kRow + subdivisions_; ++r) {
+      const unsigned int kBegin = cell_start_[r * kPaddedColumns + kColumn - subdivisions_];
+      const unsigned int kEnd = cell_start_[r * kPaddedColumns + kColumn + subdivisions_ + 1];
+      if (kBegin != kEnd) {
+        f(kBegin, kEnd);
+      }
+    }
+  }
+
+  /**
+   * Get sums over the boids of a cell.
+   *
+   * \param cell Padded cell index, from Cell::index.
+   */
+  const Aggregate& aggregate(unsigned int cell) const {
+    return aggregates_[cell];
+  }
+
+  /** Boid x coordinates ordered by cell, ghost copies included */
+  const std::vector<float>& sorted_x() const;
+  /** Boid y coordinates ordered by cell, ghost copies included */
+  const std::vector<float>& sorted_y() const;
+  /** Boid indices ordered by cell, ghost copies have the index of their boid */
+  const std::vector<unsigned int>& sorted_indices() const;
+
+  /** Number of ghost copies made by the last build() */
+  std::size_t ghost_count() const;
+  int columns() const;
+  int rows() const;
+
+ private:
+  void resize(const sf::Vector2f& world_size);
+  void add_ghosts(const std::vector<float>& x, const std::vector<float>& y, const sf::Vector2f& world_size);
+  void sort_into_cells(const std::vector<float>& x, const std::vector<float>& y, const std::vector<float>& sin,
+                       const std::vector<float>& cos);
+
+  int column(float x) const {
+    /** Boids can be slightly outside the world right after a resize, clamp them to the border cells */
+    return std::min(std::max(static_cast<int>(x / cell_width_), 0), columns_ - 1);
+  }
+
+  int row(float y) const {
+    return std::min(std::max(static_cast<int>(y / cell_height_), 0), rows_ - 1);
+  }
+
+  /** Index of a cell in the padded grid, the ghost ring is subdivisions_ cells wide */
+  unsigned int padded_cell_index(int column, int row) const {
+    return (row + subdivisions_) * (columns_ + 2 * subdivisions_) + column + subdivisions_;
+  }
+
+  float radius_;
+  int subdivisions_;
+  bool periodic_ = false;
+  int columns_ = 1;
+  int rows_ = 1;
+  /** Size of the interior cells, at least radius_ / subdivisions_ */
+  float cell_width_ = 1;
+  float cell_height_ = 1;
+  /** Padded cell of every boid, by boid index */
+  std::vector<unsigned int> cell_of_;
+  /** Ghost copies: padded cell, boid index and shifted coordinates */
+  std::vector<unsigned int> ghost_cell_;
+  std::vector<unsigned int> ghost_index_;
+  std::vector<float> ghost_x_;
+  std::vector<float> ghost_y_;
+  /** Offset of every padded cell in indices_, one extra entry marks the end */
+  std::vector<unsigned int> cell_start_;
+  std::vector<Aggregate> aggregates_;
+  /** Boid indices ordered by cell */
+  std::vector<unsigned int> indices_;
+  /** Boid coordinates ordered by cell */
+  std::vector<float> x_;
+  std::vector<float> y_;
+};
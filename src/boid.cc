@@ -1,41 +1,171 @@
 #include "boid.h"
 
-#include <random>
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include "random.h"
+#include "spatial_order.h"
 
 const Boid::Config Boid::kConfig_ = {};
+constexpr BoidStore::size_type BoidStore::kInvalidIndex;
+constexpr unsigned int BoidStore::kMaxTopologicalNeighbors;
 
-void Boid::update(const Boids& boids, const Predators& predators, float dt, const sf::Vector2u& window_size) {
+namespace {
+
+/** Phase clock of untimed updates */
+struct NoPhaseClock {
+  void lap(std::chrono::steady_clock::duration BoidStore::PhaseTimes::*) {}
+};
+
+/** Time of one clock read, measured once */
+std::chrono::steady_clock::duration clock_read_time() {
+  static const std::chrono::steady_clock::duration kReadTime = [] {
+    constexpr int kReads = 1000;
+    const auto kStart = std::chrono::steady_clock::now();
+    for (int i = 1; i < kReads; ++i) {
+      std::chrono::steady_clock::now();
+    }
+    return (std::chrono::steady_clock::now() - kStart) / kReads;
+  }();
+  return kReadTime;
+}
+
+/**
+ * Adds the time since the last lap to a phase.
+ *
+ * Phases take tens of nanoseconds, about as long as a clock read, so the
+ * read is taken off every lap.
+ */
+class PhaseClock {
+ public:
+  explicit PhaseClock(BoidStore::PhaseTimes& times)
+    : times_(times),
+      read_time_(clock_read_time()),
+      last_(std::chrono::steady_clock::now()) {}
+
+  void lap(std::chrono::steady_clock::duration BoidStore::PhaseTimes::* phase) {
+    const auto kNow = std::chrono::steady_clock::now();
+    times_.*phase += kNow - last_ - read_time_;
+    last_ = kNow;
+  }
+
+ private:
+  BoidStore::PhaseTimes& times_;
+  std::chrono::steady_clock::duration read_time_;
+  std::chrono::steady_clock::time_point last_;
+};
+
+/** Candidate ranges of the grid, its cells cannot be skipped */
+template<class F>
+void for_each_nearest_candidate_range(const Grid& grid, const sf::Vector2f& position, F&& f) {
+  grid.for_each_candidate_range(position, f);
+}
+
+/** Candidate ranges of the quadtree, leaves beyond the farthest nearest flockmate are skipped */
+template<class F>
+void for_each_nearest_candidate_range(const Quadtree& quadtree, const sf::Vector2f& position, F&& f) {
+  quadtree.for_each_nearest_candidate_range(position, f);
+}
+
+/** Candidate ranges of the aggregate grid, its cells cannot be skipped */
+template<class F>
+void for_each_nearest_candidate_range(const AggregateGrid& aggregate_grid, const sf::Vector2f& position, F&& f) {
+  aggregate_grid.for_each_candidate_range(position, f);
+}
+
+}
+
+template<class Neighbors, class PhaseClock>
+void BoidStore::update(size_type index, State& boid, const Neighbors& neighbors, const PredatorIndex& predators, float dt, const sf::Vector2f& world_size, PhaseClock& clock) const {
+  integrate(boid, dt, world_size);
+  clock.lap(&PhaseTimes::integration);
+
+  /** Predators */
+  const bool kFleeing = handle_predators(boid, predators, dt);
+  clock.lap(&PhaseTimes::rule_evaluation);
+  if (kFleeing) {
+    return;
+  }
+
+  /** No predators, perform normal tasks */
+  const Flockmates kFlockmates = get_flockmates(index, boid, neighbors);
+  clock.lap(&PhaseTimes::neighbor_search);
+  apply_flocking_rules(boid, kFlockmates, dt);
+  clock.lap(&PhaseTimes::rule_evaluation);
+}
+
+template<class Neighbors>
+void BoidStore::update(size_type index, const Neighbors& neighbors, const PredatorIndex& predators, float dt,
+                       const sf::Vector2f& world_size, PhaseTimes* times) {
+  if (times == nullptr) {
+    State boid = load_state(index);
+    NoPhaseClock clock;
+    update(index, boid, neighbors, predators, dt, world_size, clock);
+    next_.store(index, boid, heading_mode_);
+    return;
+  }
+
+  PhaseClock clock(*times);
+  State boid = load_state(index);
+  clock.lap(&PhaseTimes::integration);
+  update(index, boid, neighbors, predators, dt, world_size, clock);
+  next_.store(index, boid, heading_mode_);
+  clock.lap(&PhaseTimes::integration);
+}
+
+template void BoidStore::update(size_type, const Grid&, const PredatorIndex&, float, const sf::Vector2f&, PhaseTimes*);
+template void BoidStore::update(size_type, const NeighborList&, const PredatorIndex&, float, const sf::Vector2f&,
+                                PhaseTimes*);
+template void BoidStore::update(size_type, const Quadtree&, const PredatorIndex&, float, const sf::Vector2f&,
+                                PhaseTimes*);
+template void BoidStore::update(size_type, const AggregateGrid&, const PredatorIndex&, float, const sf::Vector2f&,
+                                PhaseTimes*);
+
+BoidStore::State BoidStore::state(size_type index) const {
+  return load_state(index);
+}
+
+void BoidStore::integrate(State& boid, float dt, const sf::Vector2f& world_size) const {
   /** Update position */
   {
-    sf::Transform rotation;
-    rotation.rotate(rot_);
-    const float kDeltaMoveSpeed = move_speed_ * dt;
-    pos_ += rotation.transformPoint(0, -kDeltaMoveSpeed);
-    if (pos_.x < 0) {
-      pos_.x = window_size.x;
+    const float kDeltaMoveSpeed = boid.move_speed * dt;
+    if (heading_mode_ == HeadingMode::kVector) {
+      boid.pos += boid.heading * kDeltaMoveSpeed;
+    } else {
+      /** Move along the rotated up vector (0, -1) */
+      const float kRad = deg2rad(boid.rot);
+      boid.pos += sf::Vector2f(std::sin(kRad), -std::cos(kRad)) * kDeltaMoveSpeed;
+    }
+    if (boid.pos.x < 0) {
+      boid.pos.x = world_size.x;
     }
 
-    if (pos_.x > window_size.x) {
-      pos_.x = 0;
+    if (boid.pos.x > world_size.x) {
+      boid.pos.x = 0;
     }
 
-    if (pos_.y < 0) {
-      pos_.y = window_size.y;
+    if (boid.pos.y < 0) {
+      boid.pos.y = world_size.y;
     }
 
-    if (pos_.y > window_size.y) {
-      pos_.y = 0;
+    if (boid.pos.y > world_size.y) {
+      boid.pos.y = 0;
     }
   }
 
+  if (heading_mode_ == HeadingMode::kVector) {
+    boid.heading = rotate_towards(boid.heading, boid.target_heading, deg2rad(boid.rotation_speed * dt));
+    return;
+  }
+
   /** Normalize rotations before calculation */
-  rot_ = constraint_angle_0_360(rot_);
-  target_rot_ = constraint_angle_0_360(target_rot_);
+  boid.rot = constraint_angle_0_360(boid.rot);
+  boid.target_rot = constraint_angle_0_360(boid.target_rot);
 
   {
     float rotation_direction = 1;
 
-    float rotation_delta = target_rot_ - rot_;
+    float rotation_delta = boid.target_rot - boid.rot;
 
     while(rotation_delta < 0) {
       rotation_delta += 360;
@@ -45,176 +175,912 @@ void Boid::update(const Boids& boids, const Predators& predators, float dt, cons
       rotation_direction = -1;
     }
 
-    rot_ += rotation_direction * rotation_speed_ * dt;
+    boid.rot += rotation_direction * boid.rotation_speed * dt;
   }
 
   /** Normalize rotations after calculations */
-  rot_ = constraint_angle_0_360(rot_);
-  target_rot_ = constraint_angle_0_360(target_rot_);
+  boid.rot = constraint_angle_0_360(boid.rot);
+  boid.target_rot = constraint_angle_0_360(boid.target_rot);
+}
 
-  /** Predators */
-  if (handle_predators(predators, dt)) {
+void BoidStore::apply_flocking_rules(State& boid, const Flockmates& flockmates, float dt) const {
+  /** If at this point there is only one flockmate (this boid) then there is nothing to do */
+  if (flockmates.cohesion.count == 1) {
+    boid.target_rot = constraint_angle_0_360(boid.target_rot);
+    apply_rotation_jitter_if_needed(boid, dt);
     return;
   }
 
-  /** No predators, perform normal tasks */
+  if (flockmates.separation.count > 1) {
+    /** Separation */
+    steer(boid, flockmates.separation.center_of_mass(), true);
+  } else if (flockmates.alignment.count > 1) {
+    /** Alignment */
+    if (heading_mode_ == HeadingMode::kVector) {
+      /** Sums of unit headings, (sin, -cos) of the average rotation */
+      const sf::Vector2f kHeadingSum(flockmates.alignment.sin_sum, -flockmates.alignment.cos_sum);
+      const float kLength = length_2d(kHeadingSum);
+      boid.target_heading = kLength > 0 ? kHeadingSum / kLength : sf::Vector2f(0, -1);
+    } else {
+      const float kAverageRotation =
+        rad2deg(std::atan2(flockmates.alignment.sin_sum, flockmates.alignment.cos_sum));
+      boid.target_rot = constraint_angle_0_360(kAverageRotation);
+    }
+    apply_rotation_jitter_if_needed(boid, dt);
+  } else if (flockmates.cohesion.count > 1) {
+    /** Cohesion */
+    steer(boid, flockmates.cohesion.center_of_mass(), false);
+  }
 
-  /** Cohesion */
-  const std::vector<Boid> kCohesionFlockmates = get_flockmates(boids, cohesion_distance());
-  /** If at this point there is only one flockmate (this boid) then there is nothing to do */
-  if (kCohesionFlockmates.size() == 1) {
-    target_rot_ = constraint_angle_0_360(target_rot_);
-    apply_rotation_jitter_if_needed(dt);
+}
+
+void BoidStore::steer(State& boid, const sf::Vector2f& point, bool away) const {
+  const sf::Vector2f kDelta = point - boid.pos;
+  if (heading_mode_ == HeadingMode::kVector) {
+    /** Rotation atan2(dy, dx) + 90 points at the point, atan2(0, 0) is 0 */
+    const float kLength = length_2d(kDelta);
+    const sf::Vector2f kTowards = kLength > 0 ? kDelta / kLength : sf::Vector2f(1, 0);
+    boid.target_heading = away ? -kTowards : kTowards;
     return;
   }
-  const sf::Vector2f& kCohesionFlockmateCenterOfMass = center_of_mass(kCohesionFlockmates);
-
-  /** Alignment */
-  const std::vector<Boid> kAlignmentFlockmates = get_flockmates(kCohesionFlockmates, alignment_distance());
-  const sf::Vector2f& kAlignmentFlockmateCenterOfMass = center_of_mass(kAlignmentFlockmates);
-
-  /** Separation */
-  const std::vector<Boid> kSeparationFlockmates = get_flockmates(kAlignmentFlockmates, separation_distance());
-  const sf::Vector2f& kSeparationFlockmateCenterOfMass = center_of_mass(kSeparationFlockmates);
-
-  if (kSeparationFlockmates.size() > 1) {
-    const float kBoidToCenterOfMassRotation =
-      rad2deg(std::atan2(kSeparationFlockmateCenterOfMass.y - pos_.y,
-                         kSeparationFlockmateCenterOfMass.x - pos_.x));
-
-    target_rot_ = constraint_angle_0_360(kBoidToCenterOfMassRotation - 90);
-  } else if (kAlignmentFlockmates.size() > 1) {
-    const float kAverageRotation =
-      [&]{
-        using SinCosSum = std::tuple<float, float>;
-        SinCosSum sin_cos_sum =
-          std::accumulate(
-            kAlignmentFlockmates.begin(),
-            kAlignmentFlockmates.end(),
-            SinCosSum(0.0f, 0.0f),
-            [&](SinCosSum result, const auto& boid) {
-              const float kRad = deg2rad(boid.rot_);
-              std::get<0>(result) += std::sin(kRad);
-              std::get<1>(result) += std::cos(kRad);
-              return result;
-            }
-          );
-
-        return rad2deg(std::atan2(std::get<0>(sin_cos_sum), std::get<1>(sin_cos_sum)));
-      }();
-    target_rot_ = constraint_angle_0_360(kAverageRotation);
-    apply_rotation_jitter_if_needed(dt);
-  } else if (kCohesionFlockmates.size() > 1) {
-    const float kBoidToCenterOfMassRotation =
-      rad2deg(std::atan2(kCohesionFlockmateCenterOfMass.y - pos_.y, kCohesionFlockmateCenterOfMass.x - pos_.x));
 
-    target_rot_ = constraint_angle_0_360(kBoidToCenterOfMassRotation + 90);
+  const float kBoidToPointRotation = rad2deg(std::atan2(kDelta.y, kDelta.x));
+  boid.target_rot = constraint_angle_0_360(kBoidToPointRotation + (away ? -90 : 90));
+}
+
+BoidStore::BoidStore(size_type count)
+  : col_(count, sf::Color::White) {
+  current_.resize(count);
+  next_.resize(count);
+  slot_of_.reserve(count);
+  for (size_type i = 0; i < count; ++i) {
+    allocate_slot(i);
+  }
+}
+
+BoidStore::size_type BoidStore::size() const {
+  return current_.x.size();
+}
+
+bool BoidStore::empty() const {
+  return current_.x.empty();
+}
+
+void BoidStore::reserve(size_type count) {
+  current_.reserve(count);
+  next_.reserve(count);
+  col_.reserve(count);
+  slot_of_.reserve(count);
+}
+
+BoidHandle BoidStore::push_back(const sf::Vector2f& pos, float rot, const sf::Color& col) {
+  /** The back buffer mirrors the flock so it always holds the previous positions */
+  const State kBoid = make_state(pos, rot);
+  current_.push_back(kBoid);
+  next_.push_back(kBoid);
+  col_.push_back(col);
+  return allocate_slot(size() - 1);
+}
+
+void BoidStore::assign(size_type index, const sf::Vector2f& pos, float rot, const sf::Color& col) {
+  const State kBoid = make_state(pos, rot);
+  current_.store(index, kBoid, heading_mode_);
+  next_.store(index, kBoid, heading_mode_);
+  col_[index] = col;
+}
+
+void BoidStore::sort_spatially(const sf::Vector2f& world_size) {
+  morton_order(current_.x, current_.y, world_size, sort_order_, sort_keys_, sort_scratch_);
+  current_.permute(sort_order_, permute_scratch_);
+  next_.permute(sort_order_, permute_scratch_);
+
+  color_scratch_.resize(size());
+  slot_scratch_.resize(size());
+  for (size_type i = 0; i < size(); ++i) {
+    color_scratch_[i] = col_[sort_order_[i]];
+    slot_scratch_[i] = slot_of_[sort_order_[i]];
+    slots_[slot_scratch_[i]].index = i;
+  }
+  col_.swap(color_scratch_);
+  slot_of_.swap(slot_scratch_);
+}
+
+bool BoidStore::erase(const BoidHandle& handle) {
+  const size_type kIndex = index_of(handle);
+  if (kIndex == kInvalidIndex) {
+    return false;
+  }
+
+  release_slot(handle.slot);
+  current_.swap_remove(kIndex);
+  next_.swap_remove(kIndex);
+  col_[kIndex] = col_.back();
+  col_.pop_back();
+  slot_of_[kIndex] = slot_of_.back();
+  slot_of_.pop_back();
+  if (kIndex < size()) {
+    slots_[slot_of_[kIndex]].index = kIndex;
+  }
+  return true;
+}
+
+void BoidStore::pop_back(size_type count) {
+  count = std::min(count, size());
+  const size_type kSize = size() - count;
+  for (size_type i = kSize; i < size(); ++i) {
+    release_slot(slot_of_[i]);
+  }
+
+  current_.resize(kSize);
+  next_.resize(kSize);
+  col_.resize(kSize);
+  slot_of_.resize(kSize);
+}
+
+bool BoidStore::contains(const BoidHandle& handle) const {
+  return index_of(handle) != kInvalidIndex;
+}
+
+BoidStore::size_type BoidStore::index_of(const BoidHandle& handle) const {
+  if (handle.slot >= slots_.size() || slots_[handle.slot].generation != handle.generation) {
+    return kInvalidIndex;
+  }
+
+  return slots_[handle.slot].index;
+}
+
+BoidHandle BoidStore::handle(size_type index) const {
+  BoidHandle result;
+  result.slot = slot_of_[index];
+  result.generation = slots_[result.slot].generation;
+  return result;
+}
+
+BoidHandle BoidStore::allocate_slot(size_type index) {
+  std::uint32_t slot;
+  if (free_slots_.empty()) {
+    slot = slots_.size();
+    slots_.push_back(Slot{0, 0});
+  } else {
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+  }
+
+  slots_[slot].index = index;
+  slot_of_.push_back(slot);
+  return handle(index);
+}
+
+void BoidStore::release_slot(std::uint32_t slot) {
+  /** Handles to the removed boid fail the generation check from now on */
+  ++slots_[slot].generation;
+  free_slots_.push_back(slot);
+}
+
+Boid BoidStore::operator[](size_type index) const {
+  return Boid(*this, index);
+}
+
+BoidStore::const_iterator BoidStore::begin() const {
+  return const_iterator(*this, 0);
+}
+
+BoidStore::const_iterator BoidStore::end() const {
+  return const_iterator(*this, size());
+}
+
+const std::vector<float>& BoidStore::x() const {
+  return current_.x;
+}
+
+const std::vector<float>& BoidStore::y() const {
+  return current_.y;
+}
+
+const std::vector<sf::Color>& BoidStore::color() const {
+  return col_;
+}
+
+float BoidStore::rotation(size_type index) const {
+  if (heading_mode_ == HeadingMode::kVector) {
+    return constraint_angle_0_360(rad2deg(std::atan2(current_.heading_x[index], -current_.heading_y[index])));
+  }
+
+  return current_.rot[index];
+}
+
+void BoidStore::headings(std::vector<float>& sin, std::vector<float>& cos) const {
+  sin.resize(size());
+  cos.resize(size());
+  for (size_type i = 0; i < size(); ++i) {
+    NeighborSums heading;
+    add_heading(heading, i, heading_mode_ == HeadingMode::kVector);
+    sin[i] = heading.sin_sum;
+    cos[i] = heading.cos_sum;
+  }
+}
+
+sf::Vector2f BoidStore::interpolated_position(size_type index, float alpha, const sf::Vector2f& world_size) const {
+  const sf::Vector2f kCurrent(current_.x[index], current_.y[index]);
+  /** A boid that wrapped around jumped across the world, move it the short way instead */
+  const sf::Vector2f kDelta = minimum_image_2d(kCurrent - sf::Vector2f(next_.x[index], next_.y[index]), world_size);
+  return kCurrent - kDelta * (1 - alpha);
+}
+
+sf::Vector2f BoidStore::heading(size_type index) const {
+  if (heading_mode_ == HeadingMode::kVector) {
+    return sf::Vector2f(current_.heading_x[index], current_.heading_y[index]);
+  }
+
+  const float kRad = deg2rad(current_.rot[index]);
+  return sf::Vector2f(std::sin(kRad), -std::cos(kRad));
+}
+
+HeadingMode BoidStore::heading_mode() const {
+  return heading_mode_;
+}
+
+void BoidStore::set_heading_mode(HeadingMode heading_mode) {
+  if (heading_mode == heading_mode_) {
+    return;
+  }
+
+  for (size_type i = 0; i < size(); ++i) {
+    if (heading_mode == HeadingMode::kVector) {
+      const float kRad = deg2rad(current_.rot[i]);
+      const float kTargetRad = deg2rad(current_.target_rot[i]);
+      current_.heading_x[i] = std::sin(kRad);
+      current_.heading_y[i] = -std::cos(kRad);
+      current_.target_heading_x[i] = std::sin(kTargetRad);
+      current_.target_heading_y[i] = -std::cos(kTargetRad);
+    } else {
+      current_.rot[i] =
+        constraint_angle_0_360(rad2deg(std::atan2(current_.heading_x[i], -current_.heading_y[i])));
+      current_.target_rot[i] =
+        constraint_angle_0_360(rad2deg(std::atan2(current_.target_heading_x[i], -current_.target_heading_y[i])));
+    }
+  }
+  heading_mode_ = heading_mode;
+}
+
+unsigned int BoidStore::topological_neighbor_count() const {
+  return topological_neighbor_count_;
+}
+
+void BoidStore::set_topological_neighbor_count(unsigned int count) {
+  topological_neighbor_count_ = std::min(count, kMaxTopologicalNeighbors);
+}
+
+std::uint64_t BoidStore::seed() const {
+  return seed_;
+}
+
+void BoidStore::set_seed(std::uint64_t seed) {
+  seed_ = seed;
+}
+
+void BoidStore::save(SnapshotWriter& writer) const {
+  visit_snapshot(*this, writer);
+}
+
+void BoidStore::load(SnapshotReader& reader) {
+  BoidStore boids;
+  visit_snapshot(boids, reader);
+  if (!boids.consistent()) {
+    throw std::runtime_error("Cannot load snapshot: boid arrays do not fit together");
   }
 
+  /** Only the heading representation of the heading mode is saved */
+  boids.current_.resize(boids.col_.size());
+  boids.next_ = boids.current_;
+  boids.topological_neighbor_count_ = topological_neighbor_count_;
+  *this = std::move(boids);
+}
+
+void BoidStore::begin_update() {
+  next_.resize(size());
+}
+
+void BoidStore::end_update() {
+  std::swap(current_, next_);
+  ++update_count_;
+}
+
+void BoidStore::StateArrays::reserve(size_type count) {
+  x.reserve(count);
+  y.reserve(count);
+  rot.reserve(count);
+  target_rot.reserve(count);
+  heading_x.reserve(count);
+  heading_y.reserve(count);
+  target_heading_x.reserve(count);
+  target_heading_y.reserve(count);
+  move_speed.reserve(count);
+  rotation_speed.reserve(count);
+  last_time_rotation_jitter_applied_accumulator.reserve(count);
+}
+
+void BoidStore::StateArrays::resize(size_type count) {
+  const State kBoid;
+  x.resize(count, kBoid.pos.x);
+  y.resize(count, kBoid.pos.y);
+  rot.resize(count, kBoid.rot);
+  target_rot.resize(count, kBoid.target_rot);
+  heading_x.resize(count, kBoid.heading.x);
+  heading_y.resize(count, kBoid.heading.y);
+  target_heading_x.resize(count, kBoid.target_heading.x);
+  target_heading_y.resize(count, kBoid.target_heading.y);
+  move_speed.resize(count, kBoid.move_speed);
+  rotation_speed.resize(count, kBoid.rotation_speed);
+  last_time_rotation_jitter_applied_accumulator.resize(count, kBoid.last_time_rotation_jitter_applied_accumulator);
+}
+
+void BoidStore::StateArrays::push_back(const State& boid) {
+  x.push_back(boid.pos.x);
+  y.push_back(boid.pos.y);
+  rot.push_back(boid.rot);
+  target_rot.push_back(boid.target_rot);
+  heading_x.push_back(boid.heading.x);
+  heading_y.push_back(boid.heading.y);
+  target_heading_x.push_back(boid.target_heading.x);
+  target_heading_y.push_back(boid.target_heading.y);
+  move_speed.push_back(boid.move_speed);
+  rotation_speed.push_back(boid.rotation_speed);
+  last_time_rotation_jitter_applied_accumulator.push_back(boid.last_time_rotation_jitter_applied_accumulator);
+}
+
+void BoidStore::StateArrays::permute(const std::vector<std::uint32_t>& order, std::vector<float>& scratch) {
+  const auto kPermute = [&order, &scratch](std::vector<float>& values) {
+    scratch.resize(values.size());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+      scratch[i] = values[order[i]];
+    }
+    values.swap(scratch);
+  };
+  kPermute(x);
+  kPermute(y);
+  kPermute(rot);
+  kPermute(target_rot);
+  kPermute(heading_x);
+  kPermute(heading_y);
+  kPermute(target_heading_x);
+  kPermute(target_heading_y);
+  kPermute(move_speed);
+  kPermute(rotation_speed);
+  kPermute(last_time_rotation_jitter_applied_accumulator);
+}
+
+void BoidStore::StateArrays::swap_remove(size_type index) {
+  const auto kSwapRemove = [index](std::vector<float>& values) {
+    values[index] = values.back();
+    values.pop_back();
+  };
+  kSwapRemove(x);
+  kSwapRemove(y);
+  kSwapRemove(rot);
+  kSwapRemove(target_rot);
+  kSwapRemove(heading_x);
+  kSwapRemove(heading_y);
+  kSwapRemove(target_heading_x);
+  kSwapRemove(target_heading_y);
+  kSwapRemove(move_speed);
+  kSwapRemove(rotation_speed);
+  kSwapRemove(last_time_rotation_jitter_applied_accumulator);
+}
+
+BoidStore::State BoidStore::StateArrays::load(size_type index, HeadingMode heading_mode) const {
+  State boid;
+  boid.pos = sf::Vector2f(x[index], y[index]);
+  if (heading_mode == HeadingMode::kVector) {
+    boid.heading = sf::Vector2f(heading_x[index], heading_y[index]);
+    boid.target_heading = sf::Vector2f(target_heading_x[index], target_heading_y[index]);
+  } else {
+    boid.rot = rot[index];
+    boid.target_rot = target_rot[index];
+  }
+  boid.move_speed = move_speed[index];
+  boid.rotation_speed = rotation_speed[index];
+  boid.last_time_rotation_jitter_applied_accumulator = last_time_rotation_jitter_applied_accumulator[index];
+  return boid;
+}
+
+void BoidStore::StateArrays::store(size_type index, const State& boid, HeadingMode heading_mode) {
+  x[index] = boid.pos.x;
+  y[index] = boid.pos.y;
+  if (heading_mode == HeadingMode::kVector) {
+    heading_x[index] = boid.heading.x;
+    heading_y[index] = boid.heading.y;
+    target_heading_x[index] = boid.target_heading.x;
+    target_heading_y[index] = boid.target_heading.y;
+  } else {
+    rot[index] = boid.rot;
+    target_rot[index] = boid.target_rot;
+  }
+  move_speed[index] = boid.move_speed;
+  rotation_speed[index] = boid.rotation_speed;
+  last_time_rotation_jitter_applied_accumulator[index] = boid.last_time_rotation_jitter_applied_accumulator;
 }
 
 sf::Vector2f Boid::position() const {
-  return pos_;
+  return sf::Vector2f(boids_->x()[index_], boids_->y()[index_]);
 }
 
 float Boid::rotation() const {
-  return rot_;
+  return boids_->rotation(index_);
+}
+
+sf::Vector2f Boid::position(float alpha, const sf::Vector2f& world_size) const {
+  return boids_->interpolated_position(index_, alpha, world_size);
+}
+
+sf::Vector2f Boid::heading() const {
+  return boids_->heading(index_);
 }
 
 sf::Color Boid::color() const {
-  return col_;
+  return boids_->color()[index_];
+}
+
+BoidHandle Boid::handle() const {
+  return boids_->handle(index_);
 }
 
-int Boid::size() const {
+int Boid::size() {
   return kConfig_.kSize;
 }
 
-int Boid::cohesion_distance() const {
+int Boid::cohesion_distance() {
   return kConfig_.kSize * kConfig_.kCohesionDistanceFactor;
 }
 
-int Boid::alignment_distance() const {
+int Boid::alignment_distance() {
   return kConfig_.kSize * kConfig_.kAlignmentDistanceFactor;
 }
 
-int Boid::separation_distance() const {
+int Boid::separation_distance() {
   return kConfig_.kSize * kConfig_.kSeparationDistanceFactor;
 }
 
-Predators Boid::get_local_predators(const Predators& predators, int distance) const {
-  Predators result;
-  std::copy_if(predators.begin(), predators.end(), std::back_inserter(result), [&](const auto& predator) {
-    return distance_2d(pos_, predator.position) < distance + predator.size;
+int Boid::predator_detection_distance() {
+  return alignment_distance();
+}
+
+BoidStore::Flockmates BoidStore::own_flockmates(const State& boid) const {
+  /** The boid always counts as its own flockmate, with its already updated state */
+  Flockmates result;
+  result.cohesion.count = 1;
+  result.cohesion.position_sum = boid.pos;
+  result.alignment.count = 1;
+  if (heading_mode_ == HeadingMode::kVector) {
+    result.alignment.sin_sum = boid.heading.x;
+    result.alignment.cos_sum = -boid.heading.y;
+  } else {
+    const float kRad = deg2rad(boid.rot);
+    result.alignment.sin_sum = std::sin(kRad);
+    result.alignment.cos_sum = std::cos(kRad);
+  }
+  result.separation.count = 1;
+  result.separation.position_sum = boid.pos;
+  return result;
+}
+
+NeighborRadii BoidStore::neighbor_radii() {
+  const float kCohesionDistance = Boid::cohesion_distance();
+  const float kAlignmentDistance = Boid::alignment_distance();
+  const float kSeparationDistance = Boid::separation_distance();
+  return NeighborRadii{
+    kCohesionDistance * kCohesionDistance,
+    kAlignmentDistance * kAlignmentDistance,
+    kSeparationDistance * kSeparationDistance
+  };
+}
+
+void BoidStore::add_heading(NeighborSums& alignment, size_type other, bool vector_heading) const {
+  ++alignment.count;
+  if (vector_heading) {
+    alignment.sin_sum += current_.heading_x[other];
+    alignment.cos_sum -= current_.heading_y[other];
+  } else {
+    const float kRad = deg2rad(current_.rot[other]);
+    alignment.sin_sum += std::sin(kRad);
+    alignment.cos_sum += std::cos(kRad);
+  }
+}
+
+BoidStore::Flockmates BoidStore::get_flockmates(size_type index, const State& boid, const Grid& grid) const {
+  if (topological_neighbor_count_ > 0) {
+    return get_nearest_in_ranges(index, boid, grid);
+  }
+  return get_flockmates_in_ranges(index, boid, grid);
+}
+
+BoidStore::Flockmates BoidStore::get_flockmates(size_type index, const State& boid, const Quadtree& quadtree) const {
+  if (topological_neighbor_count_ > 0) {
+    return get_nearest_in_ranges(index, boid, quadtree);
+  }
+  return get_flockmates_in_ranges(index, boid, quadtree);
+}
+
+BoidStore::Flockmates BoidStore::get_flockmates(size_type index, const State& boid,
+                                                const AggregateGrid& aggregate_grid) const {
+  if (topological_neighbor_count_ > 0) {
+    return get_nearest_in_ranges(index, boid, aggregate_grid);
+  }
+
+  Flockmates result = own_flockmates(boid);
+  const NeighborRadii kRadii = neighbor_radii();
+  /** Cells to search next to each other are searched as one range */
+  unsigned int range_begin = 0;
+  unsigned int range_end = 0;
+  aggregate_grid.for_each_cell(boid.pos, [&](const AggregateGrid::Cell& cell) {
+    if (cell.min_distance_squared >= kRadii.cohesion_squared) {
+      return;
+    }
+
+    /** Separation flockmates are few and close, so cells within the separation distance are always searched */
+    const bool kInsideAlignment = cell.max_distance_squared < kRadii.alignment_squared;
+    const bool kOutsideAlignment = cell.min_distance_squared >= kRadii.alignment_squared;
+    if (cell.max_distance_squared >= kRadii.cohesion_squared || cell.min_distance_squared < kRadii.separation_squared
+        || (!kInsideAlignment && !kOutsideAlignment)) {
+      if (cell.begin != range_end) {
+        add_flockmates_in_range(index, boid, aggregate_grid, range_begin, range_end, result);
+        range_begin = cell.begin;
+      }
+      range_end = cell.end;
+      return;
+    }
+
+    /** Never the own cell, its minimum distance of zero is within the separation distance */
+    const AggregateGrid::Aggregate& aggregate = aggregate_grid.aggregate(cell.index);
+
+    result.cohesion.count += aggregate.count;
+    result.cohesion.position_sum += aggregate.position_sum;
+    if (kInsideAlignment) {
+      result.alignment.count += aggregate.count;
+      result.alignment.sin_sum += aggregate.sin_sum;
+      result.alignment.cos_sum += aggregate.cos_sum;
+    }
+  });
+  add_flockmates_in_range(index, boid, aggregate_grid, range_begin, range_end, result);
+  return result;
+}
+
+template<class SpatialIndex>
+BoidStore::Flockmates BoidStore::get_flockmates_in_ranges(size_type index, const State& boid,
+                                                          const SpatialIndex& spatial_index) const {
+  Flockmates result = own_flockmates(boid);
+  spatial_index.for_each_candidate_range(boid.pos, [&](unsigned int begin, unsigned int end) {
+    add_flockmates_in_range(index, boid, spatial_index, begin, end, result);
   });
   return result;
 }
 
-sf::Vector2f Boid::center_of_mass(const Predators& predators) const {
-  return std::accumulate(
-    predators.begin(),
-    predators.end(),
-    sf::Vector2f(),
-    [&](auto result, const auto& predator) {
-      result.x += predator.position.x / predators.size();
-      result.y += predator.position.y / predators.size();
-      return result;
+template<class SpatialIndex>
+void BoidStore::add_flockmates_in_range(size_type index, const State& boid, const SpatialIndex& spatial_index,
+                                        unsigned int begin, unsigned int end, Flockmates& flockmates) const {
+  const NeighborRadii kRadii = neighbor_radii();
+  const NeighborFilter kFilter = get_neighbor_filter();
+  const std::vector<float>& kSortedX = spatial_index.sorted_x();
+  const std::vector<float>& kSortedY = spatial_index.sorted_y();
+  const std::vector<unsigned int>& kSortedIndices = spatial_index.sorted_indices();
+  const bool kVectorHeading = heading_mode_ == HeadingMode::kVector;
+
+  for (unsigned int block = begin; block < end; block += kNeighborFilterBlockSize) {
+    const std::size_t kCount = std::min<std::size_t>(end - block, kNeighborFilterBlockSize);
+    const NeighborMasks kMasks =
+      kFilter(&kSortedX[block], &kSortedY[block], kCount, boid.pos.x, boid.pos.y, kRadii);
+
+    /** Separation and alignment masks are subsets of the cohesion mask */
+    for (std::uint64_t mask = kMasks.cohesion; mask != 0; mask &= mask - 1) {
+      const unsigned int kSorted = block + __builtin_ctzll(mask);
+      const unsigned int kOther = kSortedIndices[kSorted];
+      if (kOther == index) {
+        continue;
+      }
+
+      const std::uint64_t kBit = mask & (~mask + 1);
+      const sf::Vector2f kFlockmatePos(kSortedX[kSorted], kSortedY[kSorted]);
+      ++flockmates.cohesion.count;
+      flockmates.cohesion.position_sum += kFlockmatePos;
+
+      if (kMasks.alignment & kBit) {
+        add_heading(flockmates.alignment, kOther, kVectorHeading);
+      }
+
+      if (kMasks.separation & kBit) {
+        ++flockmates.separation.count;
+        flockmates.separation.position_sum += kFlockmatePos;
+      }
     }
-  );
+  }
 }
 
-bool Boid::handle_predators(const Predators& predators, float dt) {
-  const int kPredatorDetectionDistance = alignment_distance();
-  const Predators& kLocalPredators = get_local_predators(predators, kPredatorDetectionDistance);
-  if (!kLocalPredators.empty()) {
-    const sf::Vector2f& kPreadtorsCenterOfMass = center_of_mass(kLocalPredators);
-    const float kBoidToCenterOfMassRotation =
-      rad2deg(std::atan2(kPreadtorsCenterOfMass.y - pos_.y,
-                         kPreadtorsCenterOfMass.x - pos_.x));
+template<class SpatialIndex>
+BoidStore::Flockmates BoidStore::get_nearest_in_ranges(size_type index, const State& boid,
+                                                       const SpatialIndex& spatial_index) const {
+  const NeighborFilter kFilter = get_neighbor_filter();
+  const std::vector<float>& kSortedX = spatial_index.sorted_x();
+  const std::vector<float>& kSortedY = spatial_index.sorted_y();
+  const std::vector<unsigned int>& kSortedIndices = spatial_index.sorted_indices();
+  /** Only the cohesion mask is used, it shrinks to the farthest of the nearest flockmates once k are found */
+  const float kCohesionSquared = neighbor_radii().cohesion_squared;
+  NeighborRadii radii = {kCohesionSquared, kCohesionSquared, kCohesionSquared};
+  NearestNeighbor nearest[kMaxTopologicalNeighbors];
+  unsigned int nearest_count = 0;
+
+  for_each_nearest_candidate_range(spatial_index, boid.pos, [&](unsigned int begin, unsigned int end) {
+    for (unsigned int block = begin; block < end; block += kNeighborFilterBlockSize) {
+      const std::size_t kCount = std::min<std::size_t>(end - block, kNeighborFilterBlockSize);
+      const NeighborMasks kMasks =
+        kFilter(&kSortedX[block], &kSortedY[block], kCount, boid.pos.x, boid.pos.y, radii);
 
-    target_rot_ = kBoidToCenterOfMassRotation - 90;
+      for (std::uint64_t mask = kMasks.cohesion; mask != 0; mask &= mask - 1) {
+        const unsigned int kSorted = block + __builtin_ctzll(mask);
+        const unsigned int kOther = kSortedIndices[kSorted];
+        if (kOther == index) {
+          continue;
+        }
+
+        const sf::Vector2f kFlockmatePos(kSortedX[kSorted], kSortedY[kSorted]);
+        const sf::Vector2f kDelta = kFlockmatePos - boid.pos;
+        keep_nearest(nearest, nearest_count, {kDelta.x * kDelta.x + kDelta.y * kDelta.y, kOther, kFlockmatePos});
+      }
+
+      if (nearest_count == topological_neighbor_count_) {
+        const float kFarthest = nearest[nearest_count - 1].distance_squared;
+        radii = {kFarthest, kFarthest, kFarthest};
+      }
+    }
+    return radii.cohesion_squared;
+  });
+  return sum_nearest(boid, nearest, nearest_count);
+}
+
+void BoidStore::keep_nearest(NearestNeighbor* nearest, unsigned int& count, const NearestNeighbor& candidate) const {
+  /** Sorted by distance, insertion moves less than sifting a heap for this few flockmates */
+  unsigned int i = count;
+  if (count < topological_neighbor_count_) {
+    ++count;
+  } else if (candidate < nearest[count - 1]) {
+    /** The farthest one drops out */
+    --i;
+  } else {
+    return;
+  }
+
+  for (; i > 0 && candidate < nearest[i - 1]; --i) {
+    nearest[i] = nearest[i - 1];
+  }
+  nearest[i] = candidate;
+}
+
+BoidStore::Flockmates BoidStore::sum_nearest(const State& boid, const NearestNeighbor* nearest,
+                                             unsigned int count) const {
+  Flockmates result = own_flockmates(boid);
+  const NeighborRadii kRadii = neighbor_radii();
+  const bool kVectorHeading = heading_mode_ == HeadingMode::kVector;
+  for (unsigned int i = 0; i < count; ++i) {
+    ++result.cohesion.count;
+    result.cohesion.position_sum += nearest[i].pos;
+
+    if (nearest[i].distance_squared < kRadii.alignment_squared) {
+      add_heading(result.alignment, nearest[i].index, kVectorHeading);
+    }
+
+    if (nearest[i].distance_squared < kRadii.separation_squared) {
+      ++result.separation.count;
+      result.separation.position_sum += nearest[i].pos;
+    }
+  }
+  return result;
+}
+
+BoidStore::Flockmates BoidStore::get_flockmates(size_type index, const State& boid,
+                                                const NeighborList& neighbors) const {
+  Flockmates result = own_flockmates(boid);
+  const NeighborRadii kRadii = neighbor_radii();
+  const bool kPeriodic = neighbors.periodic();
+  const bool kVectorHeading = heading_mode_ == HeadingMode::kVector;
+  const bool kTopological = topological_neighbor_count_ > 0;
+  NearestNeighbor nearest[kMaxTopologicalNeighbors];
+  unsigned int nearest_count = 0;
+  for (const unsigned int* other = neighbors.begin(index); other != neighbors.end(index); ++other) {
+    sf::Vector2f delta(current_.x[*other] - boid.pos.x, current_.y[*other] - boid.pos.y);
+    if (kPeriodic) {
+      delta = minimum_image_2d(delta, neighbors.world_size());
+    }
+
+    const float kDistanceSquared = delta.x * delta.x + delta.y * delta.y;
+    if (kDistanceSquared >= kRadii.cohesion_squared) {
+      continue;
+    }
+
+    /** Position on the side of the boid, like a ghost copy in the grid */
+    const sf::Vector2f kFlockmatePos = boid.pos + delta;
+    if (kTopological) {
+      keep_nearest(nearest, nearest_count, {kDistanceSquared, *other, kFlockmatePos});
+      continue;
+    }
+
+    ++result.cohesion.count;
+    result.cohesion.position_sum += kFlockmatePos;
+
+    if (kDistanceSquared < kRadii.alignment_squared) {
+      add_heading(result.alignment, *other, kVectorHeading);
+    }
+
+    if (kDistanceSquared < kRadii.separation_squared) {
+      ++result.separation.count;
+      result.separation.position_sum += kFlockmatePos;
+    }
+  }
+  if (kTopological) {
+    return sum_nearest(boid, nearest, nearest_count);
+  }
+  return result;
+}
+
+BoidStore::NeighborSums BoidStore::get_local_predators(const sf::Vector2f& pos, const PredatorIndex& predators, int distance) {
+  NeighborSums result;
+  predators.for_each_candidate(pos, [&](const Predator& predator) {
+    if (distance_2d(pos, predator.position) < distance + predator.size) {
+      ++result.count;
+      result.position_sum += predator.position;
+    }
+  });
+  return result;
+}
+
+bool BoidStore::handle_predators(State& boid, const PredatorIndex& predators, float dt) const {
+  const int kPredatorDetectionDistance = Boid::predator_detection_distance();
+  const NeighborSums kLocalPredators = get_local_predators(boid.pos, predators, kPredatorDetectionDistance);
+  if (kLocalPredators.count > 0) {
+    const sf::Vector2f& kPreadtorsCenterOfMass = kLocalPredators.center_of_mass();
+    steer(boid, kPreadtorsCenterOfMass, true);
     /** Run away from the predator */
     const float kFearFactor =
-      1 - std::min(1.0f, distance_2d(kPreadtorsCenterOfMass, pos_) / kPredatorDetectionDistance);
+      1 - std::min(1.0f, distance_2d(kPreadtorsCenterOfMass, boid.pos) / kPredatorDetectionDistance);
     const float kPredatorMoveSpeed =
-      std::min(kConfig_.kDefaultMoveSpeed + (kConfig_.kPredatorEscapeMoveSpeed * kFearFactor),
-               kConfig_.kPredatorEscapeMoveSpeed);
+      std::min(Boid::kConfig_.kDefaultMoveSpeed + (Boid::kConfig_.kPredatorEscapeMoveSpeed * kFearFactor),
+               Boid::kConfig_.kPredatorEscapeMoveSpeed);
 
-    move_speed_ = std::max(move_speed_, kPredatorMoveSpeed);
+    boid.move_speed = std::max(boid.move_speed, kPredatorMoveSpeed);
 
     const float kPredatorRotationSpeed =
-      std::min(kConfig_.kDefaultMoveSpeed + (kConfig_.kPredatorEscapeRotationSpeed * kFearFactor),
-               kConfig_.kPredatorEscapeRotationSpeed);
+      std::min(Boid::kConfig_.kDefaultMoveSpeed + (Boid::kConfig_.kPredatorEscapeRotationSpeed * kFearFactor),
+               Boid::kConfig_.kPredatorEscapeRotationSpeed);
 
-    rotation_speed_ = std::max(rotation_speed_, kPredatorRotationSpeed);
+    boid.rotation_speed = std::max(boid.rotation_speed, kPredatorRotationSpeed);
 
     return true;
   } else {
     /** No predator, decelerate if needed */
-    if (move_speed_ > kConfig_.kDefaultMoveSpeed) {
-      move_speed_ -= kConfig_.kPredatorEscapeMoveSpeed * dt;
+    if (boid.move_speed > Boid::kConfig_.kDefaultMoveSpeed) {
+      boid.move_speed -= Boid::kConfig_.kPredatorEscapeMoveSpeed * dt;
     }
 
-    move_speed_= std::max(move_speed_, kConfig_.kDefaultMoveSpeed);
+    boid.move_speed= std::max(boid.move_speed, Boid::kConfig_.kDefaultMoveSpeed);
 
-    if (rotation_speed_ > kConfig_.kDefaultRotationSpeed) {
-      rotation_speed_ -= kConfig_.kPredatorEscapeRotationSpeed * dt;
+    if (boid.rotation_speed > Boid::kConfig_.kDefaultRotationSpeed) {
+      boid.rotation_speed -= Boid::kConfig_.kPredatorEscapeRotationSpeed * dt;
     }
 
-    rotation_speed_= std::max(rotation_speed_, kConfig_.kDefaultRotationSpeed);
+    boid.rotation_speed= std::max(boid.rotation_speed, Boid::kConfig_.kDefaultRotationSpeed);
   }
 
   return false;
 }
 
-void Boid::apply_rotation_jitter_if_needed(float dt) {
-  static std::random_device rd;
-  static std::mt19937 gen(rd());
-  static std::uniform_int_distribution<> random_rotation_jitter(-45, 45);
-  last_time_rotation_jitter_applied_accumulator += dt;
+void BoidStore::apply_rotation_jitter_if_needed(State& boid, float dt) const {
+  boid.last_time_rotation_jitter_applied_accumulator += dt;
 
   /** For now always apply jitter */
-  if (last_time_rotation_jitter_applied_accumulator > 0) {
-    target_rot_ = constraint_angle_0_360(target_rot_ + random_rotation_jitter(gen));
-    last_time_rotation_jitter_applied_accumulator = 0;
+  if (boid.last_time_rotation_jitter_applied_accumulator > 0) {
+    const int kJitter = random_int(random_bits(seed_, boid.random_counter), -45, 45);
+    if (heading_mode_ == HeadingMode::kVector) {
+      /** (cos, sin) of every whole degree jitter, computed once */
+      static const std::array<sf::Vector2f, 91> kJitterRotations = [] {
+        std::array<sf::Vector2f, 91> rotations;
+        for (int degrees = -45; degrees <= 45; ++degrees) {
+          rotations[degrees + 45] = cos_sin(deg2rad<float>(degrees));
+        }
+        return rotations;
+      }();
+      boid.target_heading = rotate_2d(boid.target_heading, kJitterRotations[kJitter + 45]);
+    } else {
+      boid.target_rot = constraint_angle_0_360(boid.target_rot + kJitter);
+    }
+    boid.last_time_rotation_jitter_applied_accumulator = 0;
   }
 }
+
+BoidStore::State BoidStore::load_state(size_type index) const {
+  State boid = current_.load(index, heading_mode_);
+  /** Keyed on the slot, so the stream of a boid does not change when it moves to another index */
+  boid.random_counter = update_count_ << 32 | slot_of_[index];
+  return boid;
+}
+
+template<class Store, class Visitor>
+void BoidStore::visit_snapshot(Store& boids, Visitor& visitor) {
+  visitor(boids.heading_mode_);
+  visitor(boids.seed_);
+  visitor(boids.update_count_);
+
+  auto& state = boids.current_;
+  visitor(state.x);
+  visitor(state.y);
+  if (boids.heading_mode_ == HeadingMode::kVector) {
+    visitor(state.heading_x);
+    visitor(state.heading_y);
+    visitor(state.target_heading_x);
+    visitor(state.target_heading_y);
+  } else {
+    visitor(state.rot);
+    visitor(state.target_rot);
+  }
+  visitor(state.move_speed);
+  visitor(state.rotation_speed);
+  visitor(state.last_time_rotation_jitter_applied_accumulator);
+  visitor(boids.col_);
+
+  visitor(boids.slot_of_);
+  visitor(boids.slots_);
+  visitor(boids.free_slots_);
+}
+
+bool BoidStore::consistent() const {
+  if (heading_mode_ != HeadingMode::kAngle && heading_mode_ != HeadingMode::kVector) {
+    return false;
+  }
+
+  const size_type kSize = col_.size();
+  std::vector<const std::vector<float>*> arrays = {
+    &current_.x,
+    &current_.y,
+    &current_.move_speed,
+    &current_.rotation_speed,
+    &current_.last_time_rotation_jitter_applied_accumulator
+  };
+  if (heading_mode_ == HeadingMode::kVector) {
+    arrays.insert(arrays.end(), {&current_.heading_x, &current_.heading_y,
+                                 &current_.target_heading_x, &current_.target_heading_y});
+  } else {
+    arrays.insert(arrays.end(), {&current_.rot, &current_.target_rot});
+  }
+  for (const std::vector<float>* array : arrays) {
+    if (array->size() != kSize) {
+      return false;
+    }
+  }
+
+  /** Every slot is either free or points back at the one boid that has it */
+  if (slot_of_.size() != kSize || slots_.size() != kSize + free_slots_.size()) {
+    return false;
+  }
+  std::vector<bool> taken(slots_.size(), false);
+  for (size_type i = 0; i < kSize; ++i) {
+    if (slot_of_[i] >= slots_.size() || slots_[slot_of_[i]].index != i || taken[slot_of_[i]]) {
+      return false;
+    }
+    taken[slot_of_[i]] = true;
+  }
+  for (const std::uint32_t kSlot : free_slots_) {
+    if (kSlot >= slots_.size() || taken[kSlot]) {
+      return false;
+    }
+    taken[kSlot] = true;
+  }
+  return true;
+}
+
+BoidStore::State BoidStore::make_state(const sf::Vector2f& pos, float rot) {
+  const float kRad = deg2rad(rot);
+  State boid;
+  boid.pos = pos;
+  boid.rot = rot;
+  boid.target_rot = rot;
+  boid.heading = sf::Vector2f(std::sin(kRad), -std::cos(kRad));
+  boid.target_heading = boid.heading;
+  return boid;
+}
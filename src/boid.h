@@ -1,41 +1,86 @@
 #pragma once
 
+#include <chrono>
+#include <cstdint>
+#include <iterator>
+#include <limits>
 #include <vector>
-#include <numeric>
-#include <SFML/Graphics.hpp>
+#include <SFML/Graphics/Color.hpp>
+#include <SFML/System/Vector2.hpp>
+#include "aggregate_grid.h"
+#include "grid.h"
+#include "neighbor_filter.h"
+#include "neighbor_list.h"
 #include "predator.h"
+#include "quadtree.h"
+#include "snapshot.h"
 #include "utils.h"
 
-class Boid;
-using Boids = std::vector<Boid>;
+class BoidStore;
+using Boids = BoidStore;
 
+/** How boid headings are stored and steered */
+enum class HeadingMode {
+  /** Rotation in degrees, steering with trigonometric functions */
+  kAngle,
+  /** Unit direction vector, steering with vector rotations and no trigonometric calls */
+  kVector,
+};
+
+/**
+ * Stable boid handle.
+ *
+ * Stays valid while its boid lives, however other boids are added or removed.
+ * The generation tells a removed boid apart from a newer one reusing its slot.
+ */
+struct BoidHandle {
+  std::uint32_t slot = std::numeric_limits<std::uint32_t>::max();
+  std::uint32_t generation = 0;
+};
+
+inline bool operator==(const BoidHandle& a, const BoidHandle& b) {
+  return a.slot == b.slot && a.generation == b.generation;
+}
+
+inline bool operator!=(const BoidHandle& a, const BoidHandle& b) {
+  return !(a == b);
+}
+
+/**
+ * Boid view.
+ *
+ * Thin read-only proxy to a single boid in BoidStore, it stays valid as long
+ * as the store is not resized. Use handle() to refer to a boid across frames.
+ */
 class Boid {
  public:
-  Boid() = default;
-  Boid(const sf::Vector2f& pos, float rot, const sf::Color& col)
-    : pos_(pos),
-      rot_(rot),
-      target_rot_(rot),
-      col_(col) {}
+  Boid(const BoidStore& boids, std::size_t index)
+    : boids_(&boids),
+      index_(index) {}
+
+  sf::Vector2f position() const;
 
   /**
-   * Update boid.
+   * Get position between the previous and the current update.
    *
-   * /param boids All boids.
-   * /param predators Predators.
-   * /param dt Delta time in seconds.
-   * /param window_size Window size.
+   * \param alpha Interpolation factor, 0 is the previous and 1 the current position.
+   * \param world_size World size, boids wrap around at its edges.
    */
-  void update(const Boids& boids, const Predators& predators, float dt, const sf::Vector2u& window_size);
-
-  sf::Vector2f position() const;
+  sf::Vector2f position(float alpha, const sf::Vector2f& world_size) const;
   float rotation() const;
+  /** Unit vector the boid moves along, rotation 0 points up */
+  sf::Vector2f heading() const;
   sf::Color color() const;
-  int size() const;
-  int cohesion_distance() const;
-  int alignment_distance() const;
-  int separation_distance() const;
+  BoidHandle handle() const;
+  static int size();
+  static int cohesion_distance();
+  static int alignment_distance();
+  static int separation_distance();
+  /** Boids see predators this far plus the predator size */
+  static int predator_detection_distance();
  private:
+  friend class BoidStore;
+
   /** Boid config options */
   struct Config {
     const int kSize = 10;
@@ -48,52 +93,596 @@ class Boid {
     const int kCohesionDistanceFactor = 20;
   };
 
-  Predators get_local_predators(const Predators& predators, int distance) const;
-
-  template<class T>
-  Boids get_flockmates(const T& boids, int distance) const {
-      std::vector<Boid> result;
-      std::copy_if(boids.begin(), boids.end(), std::back_inserter(result), [&](const auto& local_flockmate) {
-        return distance_2d(pos_, local_flockmate.pos_) < distance;
-      });
-      return result;
-  }
-
-  template<class T>
-  sf::Vector2f center_of_mass(const T& boids) const {
-    return std::accumulate(
-      boids.begin(),
-      boids.end(),
-      sf::Vector2f(),
-      [&](auto result, const auto& local_flockmate) {
-        result.x += local_flockmate.pos_.x / boids.size();
-        result.y += local_flockmate.pos_.y / boids.size();
-        return result;
-      }
-    );
-  }
-
-  sf::Vector2f center_of_mass(const Predators& predators) const;
+  static const Config kConfig_;
+
+  const BoidStore* boids_;
+  std::size_t index_;
+};
+
+/**
+ * Boids stored as structure of arrays.
+ *
+ * Every attribute lives in its own contiguous array, so neighbor scans only
+ * pull positions and headings through the cache and leave colors and speeds
+ * alone.
+ *
+ * The arrays are the dense part of a slot map. Boids are also reachable
+ * through stable BoidHandles, removal moves the last boid into the hole, so
+ * adding and removing k boids costs O(k) and indices stay dense.
+ */
+class BoidStore {
+ public:
+  using size_type = std::size_t;
+
+  /** Index of boids that do not exist */
+  static constexpr size_type kInvalidIndex = std::numeric_limits<size_type>::max();
+
+  /** Iterator over Boid views */
+  class const_iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Boid;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = Boid;
+
+    const_iterator(const BoidStore& boids, size_type index)
+      : boids_(&boids),
+        index_(index) {}
+
+    Boid operator*() const {
+      return Boid(*boids_, index_);
+    }
+
+    const_iterator& operator++() {
+      ++index_;
+      return *this;
+    }
+
+    bool operator==(const const_iterator& other) const {
+      return index_ == other.index_;
+    }
+
+    bool operator!=(const const_iterator& other) const {
+      return index_ != other.index_;
+    }
+
+   private:
+    const BoidStore* boids_;
+    size_type index_;
+  };
+
+  BoidStore() = default;
+  explicit BoidStore(size_type count);
+
+  size_type size() const;
+  bool empty() const;
+  void reserve(size_type count);
+
+  /**
+   * Add boid.
+   *
+   * \param pos Position.
+   * \param rot Rotation in degrees.
+   * \param col Color.
+   * \return Handle of the new boid.
+   */
+  BoidHandle push_back(const sf::Vector2f& pos, float rot, const sf::Color& col);
+
+  /**
+   * Reset boid to a fresh state.
+   *
+   * \param index Boid index.
+   * \param pos Position.
+   * \param rot Rotation in degrees.
+   * \param col Color.
+   */
+  void assign(size_type index, const sf::Vector2f& pos, float rot, const sf::Color& col);
+
+  /**
+   * Remove boid, the last boid moves into its index.
+   *
+   * \param handle Boid handle.
+   * \return False if the boid does not exist.
+   */
+  bool erase(const BoidHandle& handle);
+
+  /**
+   * Remove boids from the back of the store.
+   *
+   * \param count Number of boids to remove.
+   */
+  void pop_back(size_type count);
+
+  /**
+   * Check if boid exists.
+   *
+   * \param handle Boid handle.
+   */
+  bool contains(const BoidHandle& handle) const;
+
+  /**
+   * Get current index of boid.
+   *
+   * \param handle Boid handle.
+   * \return Index, kInvalidIndex if the boid does not exist.
+   */
+  size_type index_of(const BoidHandle& handle) const;
+
+  /**
+   * Get handle of boid.
+   *
+   * \param index Boid index.
+   */
+  BoidHandle handle(size_type index) const;
+
+  Boid operator[](size_type index) const;
+  const_iterator begin() const;
+  const_iterator end() const;
+
+  const std::vector<float>& x() const;
+  const std::vector<float>& y() const;
+  const std::vector<sf::Color>& color() const;
+
+  /**
+   * Get boid rotation, computed from the heading vector in vector heading mode.
+   *
+   * \param index Boid index.
+   * \return Rotation in degrees.
+   */
+  float rotation(size_type index) const;
+
+  /**
+   * Get heading of every boid as sine and cosine, like the alignment sums.
+   *
+   * \param sin Sines, resized to the number of boids.
+   * \param cos Cosines, resized to the number of boids.
+   */
+  void headings(std::vector<float>& sin, std::vector<float>& cos) const;
+
+  /**
+   * Get boid position between the previous and the current update.
+   *
+   * Not available while an update is running. Boids that wrapped around the
+   * world edges move along the shorter way, boids added or reset since the
+   * last update stay at their current position.
+   *
+   * \param index Boid index.
+   * \param alpha Interpolation factor, 0 is the previous and 1 the current position.
+   * \param world_size World size, boids wrap around at its edges.
+   * \return Interpolated position.
+   */
+  sf::Vector2f interpolated_position(size_type index, float alpha, const sf::Vector2f& world_size) const;
+
+  /**
+   * Get boid heading, computed from the rotation in angle heading mode.
+   *
+   * \param index Boid index.
+   * \return Unit vector the boid moves along.
+   */
+  sf::Vector2f heading(size_type index) const;
+
+  HeadingMode heading_mode() const;
+
+  /**
+   * Switch heading mode, converting the heading of every boid.
+   *
+   * \param heading_mode Heading mode.
+   */
+  void set_heading_mode(HeadingMode heading_mode);
+
+  /** Most flockmates of the topological mode, bounds the work per boid */
+  static constexpr unsigned int kMaxTopologicalNeighbors = 32;
+
+  unsigned int topological_neighbor_count() const;
+
+  /**
+   * Switch between metric and topological flockmates.
+   *
+   * Metric flockmates are all boids within the rule distances, so the work
+   * per boid grows with the local density. Topological flockmates are only
+   * the k nearest boids within the cohesion distance, like starlings keep
+   * track of their seven or so nearest neighbors, so dense clumps cost no
+   * more rule work than sparse flocks. With the quadtree the search itself
+   * stops at the k nearest too. Not saved in snapshots.
+   *
+   * \param count Number of nearest flockmates k, zero for metric flockmates, at most kMaxTopologicalNeighbors.
+   */
+  void set_topological_neighbor_count(unsigned int count);
+
+  std::uint64_t seed() const;
+
+  /**
+   * Set seed of the rotation jitter.
+   *
+   * Jitter is drawn from a counter-based stream keyed on the seed, the slot
+   * of the boid and the update count, so runs with the same seed are equal
+   * no matter how many threads update the boids or how they are ordered.
+   *
+   * \param seed Seed.
+   */
+  void set_seed(std::uint64_t seed);
+
+  /**
+   * Write all boids, their handles and the random state to a snapshot.
+   *
+   * Not allowed while an update is running.
+   *
+   * \param writer Snapshot writer.
+   */
+  void save(SnapshotWriter& writer) const;
+
+  /**
+   * Replace all boids with boids read from a snapshot written by save().
+   *
+   * Handles saved with the boids stay valid. There is no previous state to
+   * interpolate from until the next update.
+   *
+   * \param reader Snapshot reader.
+   * \throws std::runtime_error If the snapshot is damaged, the store is unchanged then.
+   */
+  void load(SnapshotReader& reader);
+
+  /**
+   * Reorder boids along a Z-order curve of their positions.
+   *
+   * Boids close in space end up close in memory, so the state reads of a
+   * neighbor scan hit the cache more often. Indices change, handles stay
+   * valid. Not allowed while an update is running.
+   *
+   * \param world_size World size.
+   */
+  void sort_spatially(const sf::Vector2f& world_size);
+
+  /**
+   * Start a double buffered update.
+   *
+   * Every boid has to be updated before end_update() is called.
+   */
+  void begin_update();
+
+  /** Time spent in the phases of one or more updates */
+  struct PhaseTimes {
+    std::chrono::steady_clock::duration neighbor_search{0};
+    /** Flocking rules and predator avoidance */
+    std::chrono::steady_clock::duration rule_evaluation{0};
+    /** Loading and storing the boid state included */
+    std::chrono::steady_clock::duration integration{0};
+  };
+
+  /**
+   * Update boid.
+   *
+   * Reads the state of the previous update and writes the new state into
+   * the back buffer, so updates of different boids can run in parallel.
+   *
+   * Neighbors is a Grid, a NeighborList, a Quadtree or an AggregateGrid,
+   * built with a cell size or radius of at least Boid::cohesion_distance().
+   *
+   * Reading the clock between the phases costs more than short phases take,
+   * so time only a sample of the boids.
+   *
+   * /param index Boid index.
+   * /param neighbors Spatial index or Verlet lists of the boids.
+   * /param predators Predators of this update.
+   * /param dt Delta time in seconds.
+   * /param world_size World size, boids wrap around at its edges.
+   * /param times Phase times, added to, null to not time the update.
+   */
+  template<class Neighbors>
+  void update(size_type index, const Neighbors& neighbors, const PredatorIndex& predators, float dt,
+              const sf::Vector2f& world_size, PhaseTimes* times = nullptr);
+
+  /** Finish update, the new state becomes visible. */
+  void end_update();
+
+  /**
+   * Update phases.
+   *
+   * update() runs integrate(), handle_predators(), get_flockmates() and
+   * apply_flocking_rules() in this order on a working copy of one boid. They
+   * are public so every phase can be measured on its own.
+   */
+
+  /** Working copy of the mutable state of one boid */
+  struct State {
+    sf::Vector2f pos;
+    /** Heading in angle mode */
+    float rot = 0;
+    float target_rot = 0;
+    /** Heading in vector mode, rotation 0 points up */
+    sf::Vector2f heading = sf::Vector2f(0, -1);
+    sf::Vector2f target_heading = sf::Vector2f(0, -1);
+    float move_speed = Boid::kConfig_.kDefaultMoveSpeed;
+    float rotation_speed = Boid::kConfig_.kDefaultRotationSpeed;
+    float last_time_rotation_jitter_applied_accumulator = 0;
+    /** Counter of the rotation jitter random stream, unique for every boid and update */
+    std::uint64_t random_counter = 0;
+  };
+
+  /** Running sums over the neighbors within one radius */
+  struct NeighborSums {
+    int count = 0;
+    sf::Vector2f position_sum;
+    float sin_sum = 0;
+    float cos_sum = 0;
+
+    sf::Vector2f center_of_mass() const {
+      return position_sum / static_cast<float>(count);
+    }
+  };
+
+  /** Flockmates within each of the three rule distances, the boid itself included */
+  struct Flockmates {
+    NeighborSums cohesion;
+    NeighborSums alignment;
+    NeighborSums separation;
+  };
+
+  /**
+   * Get state of the last finished update.
+   *
+   * \param index Boid index.
+   */
+  State state(size_type index) const;
+
+  /**
+   * Move boid and turn it towards its target rotation.
+   *
+   * \param boid Boid state.
+   * \param dt Delta time in seconds.
+   * \param world_size World size, boids wrap around at its edges.
+   */
+  void integrate(State& boid, float dt, const sf::Vector2f& world_size) const;
 
   /**
    * Handle predators.
    *
+   * \param boid Boid state.
    * \param preadators Predators
    * \param dt Delta time in seconds.
    * \return True if some predators were detected and some actions performed, false otherwise.
    */
-  bool handle_predators(const Predators& predators, float dt);
+  bool handle_predators(State& boid, const PredatorIndex& predators, float dt) const;
 
-  void apply_rotation_jitter_if_needed(float dt);
+  /**
+   * Gather flockmates for all three rules in a single pass over grid candidates.
+   *
+   * \param index Boid index.
+   * \param boid Boid state.
+   * \param grid Spatial index of boids.
+   * \return Flockmate sums, separation and alignment flockmates are subsets of cohesion flockmates.
+   */
+  Flockmates get_flockmates(size_type index, const State& boid, const Grid& grid) const;
 
-  static const Config kConfig_;
+  /**
+   * Gather flockmates for all three rules from a boid's Verlet list.
+   *
+   * \param index Boid index.
+   * \param boid Boid state.
+   * \param neighbors Neighbor lists.
+   * \return Flockmate sums, separation and alignment flockmates are subsets of cohesion flockmates.
+   */
+  Flockmates get_flockmates(size_type index, const State& boid, const NeighborList& neighbors) const;
 
-  sf::Vector2f pos_;
-  float rot_ = 0;
-  float target_rot_ = 0;
-  sf::Color col_ = sf::Color::White;
-  float move_speed_ = kConfig_.kDefaultMoveSpeed;
-  float rotation_speed_ = kConfig_.kDefaultRotationSpeed;
-  float last_time_rotation_jitter_applied_accumulator = 0;
-};
+  /**
+   * Gather flockmates for all three rules in a single pass over quadtree candidates.
+   *
+   * \param index Boid index.
+   * \param boid Boid state.
+   * \param quadtree Spatial index of boids.
+   * \return Flockmate sums, separation and alignment flockmates are subsets of cohesion flockmates.
+   */
+  Flockmates get_flockmates(size_type index, const State& boid, const Quadtree& quadtree) const;
+
+  /**
+   * Gather flockmates for all three rules from the cells of an aggregate grid.
+   *
+   * Cells entirely within a rule distance count with their sums, only cells
+   * cut by one and cells within the separation distance are searched boid by
+   * boid.
+   *
+   * \param index Boid index.
+   * \param boid Boid state.
+   * \param aggregate_grid Spatial index of boids with cell sums.
+   * \return Flockmate sums, separation and alignment flockmates are subsets of cohesion flockmates.
+   */
+  Flockmates get_flockmates(size_type index, const State& boid, const AggregateGrid& aggregate_grid) const;
+
+  /**
+   * Pick new target rotation from separation, alignment and cohesion.
+   *
+   * \param boid Boid state.
+   * \param flockmates Flockmates of the boid.
+   * \param dt Delta time in seconds.
+   */
+  void apply_flocking_rules(State& boid, const Flockmates& flockmates, float dt) const;
+
+ private:
+  /** Per boid state that changes on every update, one array per attribute */
+  struct StateArrays {
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> rot;
+    std::vector<float> target_rot;
+    std::vector<float> heading_x;
+    std::vector<float> heading_y;
+    std::vector<float> target_heading_x;
+    std::vector<float> target_heading_y;
+    std::vector<float> move_speed;
+    std::vector<float> rotation_speed;
+    std::vector<float> last_time_rotation_jitter_applied_accumulator;
 
+    void reserve(size_type count);
+    void resize(size_type count);
+    void push_back(const State& boid);
+    /** Move the last boid into index and drop the last one */
+    void swap_remove(size_type index);
+    /** Reorder boids so boid i is the old boid order[i] */
+    void permute(const std::vector<std::uint32_t>& order, std::vector<float>& scratch);
+    /** Only the heading representation of the heading mode is loaded and stored */
+    State load(size_type index, HeadingMode heading_mode) const;
+    void store(size_type index, const State& boid, HeadingMode heading_mode);
+  };
+
+  /**
+   * Update working copy of a boid, Neighbors is a Grid, a NeighborList, a Quadtree or an AggregateGrid.
+   *
+   * PhaseClock gets lap() called with a PhaseTimes member after every
+   * phase, an empty one compiles the timing away.
+   */
+  template<class Neighbors, class PhaseClock>
+  void update(size_type index, State& boid, const Neighbors& neighbors, const PredatorIndex& predators, float dt, const sf::Vector2f& world_size, PhaseClock& clock) const;
+
+  /**
+   * Gather flockmates from the candidate ranges of a spatial index.
+   *
+   * \param index Boid index.
+   * \param boid Boid state.
+   * \param spatial_index Grid or Quadtree, with for_each_candidate_range() and sorted arrays.
+   */
+  template<class SpatialIndex>
+  Flockmates get_flockmates_in_ranges(size_type index, const State& boid, const SpatialIndex& spatial_index) const;
+
+  /**
+   * Add the flockmates in a range of sorted boids of a spatial index.
+   *
+   * \param index Boid index.
+   * \param boid Boid state.
+   * \param spatial_index Spatial index with sorted arrays.
+   * \param begin First sorted boid.
+   * \param end Sorted boid after the last one.
+   * \param flockmates Flockmate sums, added to.
+   */
+  template<class SpatialIndex>
+  void add_flockmates_in_range(size_type index, const State& boid, const SpatialIndex& spatial_index,
+                               unsigned int begin, unsigned int end, Flockmates& flockmates) const;
+
+  /** Flockmate candidate of the topological mode */
+  struct NearestNeighbor {
+    float distance_squared;
+    size_type index;
+    /** Position on the side of the boid */
+    sf::Vector2f pos;
+
+    bool operator<(const NearestNeighbor& other) const {
+      return distance_squared < other.distance_squared;
+    }
+  };
+
+  /**
+   * Keep candidate if it is closer than the farthest of the nearest ones.
+   *
+   * \param nearest Nearest candidates so far, sorted by distance.
+   * \param count Number of nearest candidates, grows up to topological_neighbor_count().
+   * \param candidate Candidate.
+   */
+  void keep_nearest(NearestNeighbor* nearest, unsigned int& count, const NearestNeighbor& candidate) const;
+
+  /**
+   * Sum up the nearest flockmates like metric ones.
+   *
+   * \param boid Boid state.
+   * \param nearest Nearest flockmates.
+   * \param count Number of nearest flockmates.
+   */
+  Flockmates sum_nearest(const State& boid, const NearestNeighbor* nearest, unsigned int count) const;
+
+  /**
+   * Gather the nearest flockmates from the candidate ranges of a spatial index.
+   *
+   * \param index Boid index.
+   * \param boid Boid state.
+   * \param spatial_index Grid, Quadtree or AggregateGrid, the quadtree skips leaves beyond the k nearest flockmates.
+   */
+  template<class SpatialIndex>
+  Flockmates get_nearest_in_ranges(size_type index, const State& boid, const SpatialIndex& spatial_index) const;
+
+  /** Flockmate sums holding only the boid itself */
+  Flockmates own_flockmates(const State& boid) const;
+
+  /** Squared rule distances */
+  static NeighborRadii neighbor_radii();
+
+  /**
+   * Add heading of a flockmate to alignment sums.
+   *
+   * \param alignment Alignment sums.
+   * \param other Flockmate index.
+   * \param vector_heading True in vector heading mode.
+   */
+  void add_heading(NeighborSums& alignment, size_type other, bool vector_heading) const;
+
+  static NeighborSums get_local_predators(const sf::Vector2f& pos, const PredatorIndex& predators, int distance);
+
+  /**
+   * Set target heading towards or away from a point.
+   *
+   * \param boid Boid state.
+   * \param point Point.
+   * \param away True to head away from the point.
+   */
+  void steer(State& boid, const sf::Vector2f& point, bool away) const;
+
+  void apply_rotation_jitter_if_needed(State& boid, float dt) const;
+
+  /**
+   * Pass everything save() writes to a snapshot writer or reader, in file order.
+   *
+   * \param boids Store, const when saving.
+   * \param visitor SnapshotWriter or SnapshotReader.
+   */
+  template<class Store, class Visitor>
+  static void visit_snapshot(Store& boids, Visitor& visitor);
+
+  /** Check that arrays and slots read from a snapshot fit together */
+  bool consistent() const;
+
+  /**
+   * Load state of the last finished update with its random counter.
+   *
+   * \param index Boid index.
+   */
+  State load_state(size_type index) const;
+
+  static State make_state(const sf::Vector2f& pos, float rot);
+
+  /** Slot map entry, index of the boid while it lives */
+  struct Slot {
+    std::uint32_t index;
+    std::uint32_t generation;
+  };
+
+  /**
+   * Take a free slot for a new boid.
+   *
+   * \param index Boid index.
+   */
+  BoidHandle allocate_slot(size_type index);
+
+  /** Free slot of a removed boid, handles to it become stale. */
+  void release_slot(std::uint32_t slot);
+
+  /** State of the last finished update */
+  StateArrays current_;
+  /** State being written by the running update */
+  StateArrays next_;
+  std::vector<sf::Color> col_;
+  /** Slot of every boid, by index */
+  std::vector<std::uint32_t> slot_of_;
+  std::vector<Slot> slots_;
+  std::vector<std::uint32_t> free_slots_;
+  /** Buffers of sort_spatially(), kept to avoid allocations */
+  std::vector<std::uint32_t> sort_order_;
+  std::vector<std::uint64_t> sort_keys_;
+  std::vector<std::uint64_t> sort_scratch_;
+  std::vector<float> permute_scratch_;
+  std::vector<sf::Color> color_scratch_;
+  std::vector<std::uint32_t> slot_scratch_;
+  HeadingMode heading_mode_ = HeadingMode::kAngle;
+  /** Zero for metric flockmates */
+  unsigned int topological_neighbor_count_ = 0;
+  std::uint64_t seed_ = 0;
+  /** Finished updates, part of the random counter */
+  std::uint64_t update_count_ = 0;
+};
@@ -1,77 +1,168 @@
 #include "draw.h"
 
-void draw_boid_debug_info(const Boid& boid, sf::RenderWindow& window) {
-  /** Cohesion distance */
-  {
-    const int kBoidCohesionRadius = boid.cohesion_distance();
-    sf::CircleShape circle(kBoidCohesionRadius);
-    circle.setOrigin(kBoidCohesionRadius, kBoidCohesionRadius);
-    circle.move(boid.position());
-    sf::Color color = boid.color();
-    color.a = 32;
-    circle.setFillColor(color);
-    window.draw(circle);
+#include <algorithm>
+#include <array>
+#include "random.h"
+#include "utils.h"
+
+namespace {
+
+/** Corners of a regular polygon around the origin, the first one pointing up like sf::CircleShape */
+template<std::size_t N>
+std::array<sf::Vector2f, N> make_polygon(float radius) {
+  std::array<sf::Vector2f, N> points;
+  for (std::size_t i = 0; i < N; ++i) {
+    const float kAngle = i * 2 * kPi<float> / N - kPi<float> / 2;
+    points[i] = sf::Vector2f(radius * std::cos(kAngle), radius * std::sin(kAngle));
   }
+  return points;
+}
 
-  /** Alignment distance */
-  {
-    const int kBoidAlignmentRadius = boid.alignment_distance();
-    sf::CircleShape circle(kBoidAlignmentRadius);
-    circle.setOrigin(kBoidAlignmentRadius, kBoidAlignmentRadius);
-    circle.move(boid.position());
-    sf::Color color = boid.color();
-    color.a = 48;
-    circle.setFillColor(color);
-    window.draw(circle);
+/** Triangle fan of a convex polygon as a triangle list */
+template<std::size_t N>
+std::array<sf::Vector2f, (N - 2) * 3> make_triangles(const std::array<sf::Vector2f, N>& polygon) {
+  std::array<sf::Vector2f, (N - 2) * 3> triangles;
+  for (std::size_t i = 0; i + 2 < N; ++i) {
+    triangles[i * 3] = polygon[0];
+    triangles[i * 3 + 1] = polygon[i + 1];
+    triangles[i * 3 + 2] = polygon[i + 2];
   }
+  return triangles;
+}
 
-  /** Separation distance */
-  {
-    const int kBoidSeparationRadius = boid.separation_distance();
-    sf::CircleShape circle(kBoidSeparationRadius);
-    circle.setOrigin(kBoidSeparationRadius, kBoidSeparationRadius);
-    circle.move(boid.position());
-    sf::Color color = boid.color();
-    color.a = 48;
-    circle.setFillColor(color);
-    window.draw(circle);
+/** Boid geometry for rotation 0 around the boid position */
+std::array<sf::Vector2f, kBoidVertexCount> make_boid_geometry() {
+  const float kRadius = Boid::size();
+  const int kLineWidth = Boid::size() / 4;
+  const float kLeft = -(kLineWidth / 2);
+  const float kRight = kLeft + kLineWidth;
+  const std::array<sf::Vector2f, 4> kLine = {
+    sf::Vector2f(kLeft, -2 * kRadius),
+    sf::Vector2f(kRight, -2 * kRadius),
+    sf::Vector2f(kRight, 0),
+    sf::Vector2f(kLeft, 0)
+  };
+
+  std::array<sf::Vector2f, kBoidVertexCount> geometry;
+  const auto kBody = make_triangles(make_polygon<6>(kRadius));
+  const auto kLineTriangles = make_triangles(kLine);
+  std::copy(kBody.begin(), kBody.end(), geometry.begin());
+  std::copy(kLineTriangles.begin(), kLineTriangles.end(), geometry.begin() + kBody.size());
+  return geometry;
+}
+
+/** Unit circle with the default sf::CircleShape point count */
+const std::array<sf::Vector2f, 28 * 3>& unit_circle_triangles() {
+  static const auto kTriangles = make_triangles(make_polygon<30>(1));
+  return kTriangles;
+}
+
+/**
+ * Write body and direction line of one boid.
+ *
+ * \param vertex First vertex to write.
+ * \param position Boid position.
+ * \param heading Unit vector the boid moves along.
+ * \param color Boid color.
+ * \return Vertex after the boid.
+ */
+sf::Vertex* write_boid(sf::Vertex* vertex, const sf::Vector2f& position, const sf::Vector2f& heading,
+                       sf::Color color) {
+  static const std::array<sf::Vector2f, kBoidVertexCount> kGeometry = make_boid_geometry();
+  /** Heading (sin, -cos) of the rotation gives the (cos, sin) to rotate by */
+  const sf::Vector2f kCosSin(-heading.y, heading.x);
+  for (const auto& point : kGeometry) {
+    *vertex++ = sf::Vertex(position + rotate_2d(point, kCosSin), color);
   }
+  return vertex;
 }
 
-void draw_boids(const Boids& boids, sf::RenderWindow& window, bool debug_boid_drawing) {
-  for (const auto& boid : boids) {
-    if  (debug_boid_drawing) {
-      draw_boid_debug_info(boid, window);
-    }
+sf::Vertex* write_debug_circle(sf::Vertex* vertex, const sf::Vector2f& position, float radius, sf::Color color) {
+  for (const auto& point : unit_circle_triangles()) {
+    *vertex++ = sf::Vertex(position + point * radius, color);
+  }
+  return vertex;
+}
 
-    {
-      const int kBoidCircleRadius = boid.size();
-      /** Boid body */
-      {
-        sf::CircleShape circle(kBoidCircleRadius, 6);
-        circle.setOrigin(kBoidCircleRadius, kBoidCircleRadius);
-        circle.rotate(boid.rotation());
-        circle.move(boid.position());
-        circle.setFillColor(boid.color());
-        window.draw(circle);
-      }
+}
+
+void fill_boid_vertices(const Boids& boids, const BoidInterpolation& interpolation, bool debug_boid_drawing,
+                        sf::VertexArray& vertices, ThreadPool* thread_pool) {
+  const std::size_t kVerticesPerBoid = kBoidVertexCount + (debug_boid_drawing ? kBoidDebugVertexCount : 0);
+  vertices.setPrimitiveType(sf::Triangles);
+  vertices.resize(boids.size() * kVerticesPerBoid);
+  if (boids.empty()) {
+    return;
+  }
 
-      /** Boid direction indicator */
-      {
-        const int kLineWidth = kBoidCircleRadius / 4;
-        sf::RectangleShape line(sf::Vector2f(kLineWidth, kBoidCircleRadius * 2));
-        line.setOrigin(kLineWidth / 2, kBoidCircleRadius * 2);
-        line.rotate(boid.rotation());
-        line.move(boid.position());
-        line.setFillColor(boid.color());
-        window.draw(line);
+  /** Every boid has the same number of vertices, so ranges of boids are written independently */
+  sf::Vertex* const kVertices = &vertices[0];
+  parallel_for(thread_pool, boids.size(), [&](std::size_t begin, std::size_t end) {
+    sf::Vertex* vertex = kVertices + begin * kVerticesPerBoid;
+    for (std::size_t i = begin; i < end; ++i) {
+      const Boid kBoid = boids[i];
+      const sf::Vector2f kPosition = kBoid.position(interpolation.alpha, interpolation.world_size);
+      const sf::Color kColor = kBoid.color();
+      if (debug_boid_drawing) {
+        sf::Color color = kColor;
+        color.a = 32;
+        vertex = write_debug_circle(vertex, kPosition, kBoid.cohesion_distance(), color);
+        color.a = 48;
+        vertex = write_debug_circle(vertex, kPosition, kBoid.alignment_distance(), color);
+        vertex = write_debug_circle(vertex, kPosition, kBoid.separation_distance(), color);
       }
+
+      vertex = write_boid(vertex, kPosition, kBoid.heading(), kColor);
     }
+  });
+}
+
+void fill_trajectory_vertices(const TrajectoryPlayer& player, sf::VertexArray& vertices) {
+  const TrajectoryFrame& kFrame = player.frame();
+  const TrajectoryFrame& kNextFrame = player.next_frame();
+  const std::size_t kCount = kFrame.x.size();
+  /** Boids only match up between frames of the same flock */
+  const float kAlpha = kNextFrame.x.size() == kCount && kNextFrame.world_size == kFrame.world_size ? player.alpha() : 0;
+  vertices.setPrimitiveType(sf::Triangles);
+  vertices.resize(kCount * kBoidVertexCount);
+  if (kCount == 0) {
+    return;
   }
+
+  sf::Vertex* vertex = &vertices[0];
+  for (std::size_t i = 0; i < kCount; ++i) {
+    sf::Vector2f position(kFrame.x[i], kFrame.y[i]);
+    float rotation = kFrame.rotation[i];
+    if (kAlpha > 0) {
+      /** Boids that wrapped around the world edges and rotations past 360 degrees move the shorter way */
+      const sf::Vector2f kDelta(kNextFrame.x[i] - position.x, kNextFrame.y[i] - position.y);
+      position += minimum_image_2d(kDelta, kFrame.world_size) * kAlpha;
+      rotation += (constraint_angle_0_360(kNextFrame.rotation[i] - rotation + 180) - 180) * kAlpha;
+    }
+
+    const auto kColorChannel = [i](std::uint64_t channel) {
+      return static_cast<sf::Uint8>(random_int(random_bits(i, channel), 50, 255));
+    };
+    const sf::Color kColor(kColorChannel(0), kColorChannel(1), kColorChannel(2));
+    const float kRad = deg2rad(rotation);
+    vertex = write_boid(vertex, position, sf::Vector2f(std::sin(kRad), -std::cos(kRad)), kColor);
+  }
+}
+
+void draw_trajectory(const TrajectoryPlayer& player, sf::RenderWindow& window, sf::VertexArray& vertices) {
+  fill_trajectory_vertices(player, vertices);
+  window.draw(vertices);
+}
+
+void draw_boids(const Boids& boids, const BoidInterpolation& interpolation, sf::RenderWindow& window,
+                bool debug_boid_drawing, sf::VertexArray& vertices) {
+  fill_boid_vertices(boids, interpolation, debug_boid_drawing, vertices);
+  window.draw(vertices);
 }
 
-void draw_predators(const Predators& predators, sf::RenderWindow& window) {
-  for (const auto& predator : predators) {
+void draw_predators(const Predator* predators, std::size_t predator_count, sf::RenderWindow& window) {
+  for (std::size_t i = 0; i < predator_count; ++i) {
+    const Predator& predator = predators[i];
     const int kPredatorRadius = predator.size;
     sf::CircleShape circle(kPredatorRadius);
     circle.setOrigin(kPredatorRadius, kPredatorRadius);
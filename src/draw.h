@@ -1,29 +1,76 @@
 #pragma once
 
+#include <SFML/Graphics.hpp>
 #include "boid.h"
+#include "thread_pool.h"
+#include "trajectory_player.h"
+
+/** Vertices of one boid, a hexagon body and a direction line as triangles */
+constexpr std::size_t kBoidVertexCount = 18;
+
+/** Vertices of the three rule distance circles of one boid as triangles */
+constexpr std::size_t kBoidDebugVertexCount = 3 * 28 * 3;
+
+/** Where between the last two simulation steps boids are drawn */
+struct BoidInterpolation {
+  /** 0 draws the previous and 1 the current positions */
+  float alpha = 1;
+  sf::Vector2f world_size;
+};
 
 /**
- * Draw boid debug info.
+ * Write boid geometry into a triangle vertex array.
  *
- * \param boid Boid.
- * \param window Window.
+ * The array is resized to fit the flock, it keeps its storage between frames
+ * when it is reused.
+ *
+ * \param boids Boids.
+ * \param interpolation Interpolation between the last two simulation steps.
+ * \param debug_boid_drawing If rule distance circles should be written under every boid.
+ * \param vertices Vertex array to fill.
+ * \param thread_pool Thread pool to write the vertices of different boids on, null for the calling thread.
  */
-void draw_boid_debug_info(const Boid& boid, sf::RenderWindow& window);
+void fill_boid_vertices(const Boids& boids, const BoidInterpolation& interpolation, bool debug_boid_drawing,
+                        sf::VertexArray& vertices, ThreadPool* thread_pool = nullptr);
 
 /**
- * Draw boids.
+ * Draw boids with a single draw call.
  *
  * \param boids Boids.
+ * \param interpolation Interpolation between the last two simulation steps.
  * \param window Window.
  * \param debug_boid_drawing If debug info should be drawn.
+ * \param vertices Vertex array reused between frames.
+ */
+void draw_boids(const Boids& boids, const BoidInterpolation& interpolation, sf::RenderWindow& window,
+                bool debug_boid_drawing, sf::VertexArray& vertices);
+
+/**
+ * Write geometry of the boids of a trajectory playback into a triangle vertex array.
+ *
+ * Boids are drawn between the two frames around the playback position.
+ * Trajectories have no colors, every boid gets a color from its index.
+ *
+ * \param player Trajectory player.
+ * \param vertices Vertex array to fill.
+ */
+void fill_trajectory_vertices(const TrajectoryPlayer& player, sf::VertexArray& vertices);
+
+/**
+ * Draw boids of a trajectory playback with a single draw call.
+ *
+ * \param player Trajectory player.
+ * \param window Window.
+ * \param vertices Vertex array reused between frames.
  */
-void draw_boids(const Boids& boids, sf::RenderWindow& window, bool debug_boid_drawing);
+void draw_trajectory(const TrajectoryPlayer& player, sf::RenderWindow& window, sf::VertexArray& vertices);
 
 /**
  * Draw predators.
  *
  * \param predators Predators.
+ * \param predator_count Number of predators.
  * \param window Window.
  */
-void draw_predators(const Predators& predators, sf::RenderWindow& window);
+void draw_predators(const Predator* predators, std::size_t predator_count, sf::RenderWindow& window);
 
@@ -0,0 +1,180 @@
+#include "grid.h"
+
+#include <cmath>
+#include "thread_pool.h"
+
+Grid::Grid(float cell_size)
+  : cell_size_(cell_size) {}
+
+void Grid::set_cell_size(float cell_size) {
+  cell_size_ = cell_size;
+}
+
+bool Grid::periodic() const {
+  return periodic_;
+}
+
+void Grid::set_periodic(bool periodic) {
+  periodic_ = periodic;
+}
+
+float Grid::cell_size() const {
+  return cell_size_;
+}
+
+int Grid::columns() const {
+  return columns_;
+}
+
+int Grid::rows() const {
+  return rows_;
+}
+
+std::size_t Grid::ghost_count() const {
+  return ghost_cell_.size();
+}
+
+const std::vector<float>& Grid::sorted_x() const {
+  return x_;
+}
+
+const std::vector<float>& Grid::sorted_y() const {
+  return y_;
+}
+
+const std::vector<unsigned int>& Grid::sorted_indices() const {
+  return indices_;
+}
+
+void Grid::build(const std::vector<float>& x, const std::vector<float>& y, const sf::Vector2f& world_size,
+                 ThreadPool* thread_pool) {
+  resize(world_size);
+  cell_of_.resize(x.size());
+  parallel_for(thread_pool, x.size(), [&](std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i) {
+      cell_of_[i] = padded_cell_index(column(x[i]), row(y[i]));
+    }
+  });
+  add_ghosts(x, y, world_size);
+  sort_into_cells(x, y);
+}
+
+void Grid::resize(const sf::Vector2f& world_size) {
+  /** Whole cells per axis, so the ghost ring lines up with the opposite border when wrapping */
+  columns_ = std::max(1, static_cast<int>(world_size.x / cell_size_));
+  rows_ = std::max(1, static_cast<int>(world_size.y / cell_size_));
+  cell_width_ = std::max(cell_size_, world_size.x / columns_);
+  cell_height_ = std::max(cell_size_, world_size.y / rows_);
+}
+
+void Grid::add_ghosts(const std::vector<float>& x, const std::vector<float>& y, const sf::Vector2f& world_size) {
+  ghost_cell_.clear();
+  ghost_index_.clear();
+  ghost_x_.clear();
+  ghost_y_.clear();
+  if (!periodic_) {
+    return;
+  }
+
+  const auto kAddGhost = [this](std::size_t index, int column, int row, float ghost_x, float ghost_y) {
+    ghost_cell_.push_back(padded_cell_index(column, row));
+    ghost_index_.push_back(index);
+    ghost_x_.push_back(ghost_x);
+    ghost_y_.push_back(ghost_y);
+  };
+
+  /** With a single cell on an axis the ghosts on both sides would hold the same boids twice */
+  const bool kWrapX = columns_ > 1;
+  const bool kWrapY = rows_ > 1;
+  for (std::size_t i = 0; i < x.size(); ++i) {
+    const int kColumn = column(x[i]);
+    const int kRow = row(y[i]);
+
+    int ghost_column = kColumn;
+    float ghost_x = x[i];
+    if (kWrapX && kColumn == 0) {
+      ghost_column = columns_;
+      ghost_x += world_size.x;
+    } else if (kWrapX && kColumn == columns_ - 1) {
+      ghost_column = -1;
+      ghost_x -= world_size.x;
+    }
+
+    int ghost_row = kRow;
+    float ghost_y = y[i];
+    if (kWrapY && kRow == 0) {
+      ghost_row = rows_;
+      ghost_y += world_size.y;
+    } else if (kWrapY && kRow == rows_ - 1) {
+      ghost_row = -1;
+      ghost_y -= world_size.y;
+    }
+
+    if (ghost_column != kColumn) {
+      kAddGhost(i, ghost_column, kRow, ghost_x, y[i]);
+    }
+
+    if (ghost_row != kRow) {
+      kAddGhost(i, kColumn, ghost_row, x[i], ghost_y);
+    }
+
+    /** Boids in a corner cell are seen from the diagonally opposite corner too */
+    if (ghost_column != kColumn && ghost_row != kRow) {
+      kAddGhost(i, ghost_column, ghost_row, ghost_x, ghost_y);
+    }
+  }
+}
+
+void Grid::sort_into_cells(const std::vector<float>& x, const std::vector<float>& y) {
+  /** Counting sort: count boids per cell, prefix sum into offsets, then scatter */
+  cell_start_.assign((columns_ + 2) * (rows_ + 2) + 1, 0);
+  for (const unsigned int kCell : cell_of_) {
+    ++cell_start_[kCell + 1];
+  }
+
+  for (const unsigned int kCell : ghost_cell_) {
+    ++cell_start_[kCell + 1];
+  }
+
+  for (std::size_t i = 1; i < cell_start_.size(); ++i) {
+    cell_start_[i] += cell_start_[i - 1];
+  }
+
+  const std::size_t kCount = cell_of_.size() + ghost_cell_.size();
+  indices_.resize(kCount);
+  x_.resize(kCount);
+  y_.resize(kCount);
+  for (std::size_t i = 0; i < cell_of_.size(); ++i) {
+    /** cell_start_[cell] is used as insertion cursor and ends up at the start of the next cell */
+    const unsigned int kSorted = cell_start_[cell_of_[i]]++;
+    indices_[kSorted] = i;
+    x_[kSorted] = x[i];
+    y_[kSorted] = y[i];
+  }
+
+  for (std::size_t i = 0; i < ghost_cell_.size(); ++i) {
+    const unsigned int kSorted = cell_start_[ghost_cell_[i]]++;
+    indices_[kSorted] = ghost_index_[i];
+    x_[kSorted] = ghost_x_[i];
+    y_[kSorted] = ghost_y_[i];
+  }
+
+  /** Shift the cursors back so every cell starts where the previous one begins */
+  for (std::size_t i = cell_start_.size() - 1; i > 0; --i) {
+    cell_start_[i] = cell_start_[i - 1];
+  }
+  cell_start_[0] = 0;
+}
+
+int Grid::column(float x) const {
+  /** Boids can be slightly outside the world right after a resize, clamp them to the border cells */
+  return std::min(std::max(static_cast<int>(x / cell_width_), 0), columns_ - 1);
+}
+
+int Grid::row(float y) const {
+  return std::min(std::max(static_cast<int>(y / cell_height_), 0), rows_ - 1);
+}
+
+int Grid::padded_cell_index(int column, int row) const {
+  return (row + 1) * (columns_ + 2) + column + 1;
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include <SFML/System/Vector2.hpp>
+
+class ThreadPool;
+
+/**
+ * Uniform grid (cell list) spatial index.
+ *
+ * Positions are bucketed into square cells once per frame, so a neighbour
+ * query only has to look at the 3x3 block of cells around a position instead
+ * of at every boid. As long as the cell size is not smaller than the query
+ * radius that block contains every neighbour.
+ *
+ * The cells are surrounded by a ring of ghost cells. In periodic mode the
+ * boids in the border cells are copied into the ghost cells on the opposite
+ * side, shifted by the world size, so queries near an edge see neighbours
+ * across it at their minimum image position without any per pair wrapping.
+ */
+class Grid {
+ public:
+  /**
+   * Create grid.
+   *
+   * \param cell_size Cell size, the largest radius that will be queried.
+   */
+  explicit Grid(float cell_size);
+
+  bool periodic() const;
+
+  /**
+   * Enable periodic boundaries, takes effect on the next build().
+   *
+   * \param periodic True if queries should wrap around the world edges.
+   */
+  void set_periodic(bool periodic);
+
+  /**
+   * Rebuild grid.
+   *
+   * \param x X coordinates of all boids.
+   * \param y Y coordinates of all boids.
+   * \param world_size World size.
+   * \param thread_pool Thread pool to find the cells of different boids on, null for the calling thread.
+   */
+  void build(const std::vector<float>& x, const std::vector<float>& y, const sf::Vector2f& world_size,
+             ThreadPool* thread_pool = nullptr);
+
+  /**
+   * Call f with every range of sorted boids in the 3x3 cells around position.
+   *
+   * Cells of a row are stored next to each other, so there is at most one
+   * range per row and the coordinates of a range are contiguous in sorted_x()
+   * and sorted_y(). Coordinates of ghost copies are shifted to the side of
+   * the query, so they can be used as they are.
+   *
+   * \param position Query position.
+   * \param f Callable taking begin and end of a range.
+   */
+  template<class F>
+  void for_each_candidate_range(const sf::Vector2f& position, F&& f) const {
+    /** The ghost ring keeps the 3x3 block inside the padded grid */
+    const int kColumn = column(position.x) + 1;
+    const int kRow = row(position.y) + 1;
+    const int kPaddedColumns = columns_ + 2;
+    for (int r = kRow - 1; r <= kRow + 1; ++r) {
+      const unsigned int kBegin = cell_start_[r * kPaddedColumns + kColumn - 1];
+      const unsigned int kEnd = cell_start_[r * kPaddedColumns + kColumn + 2];
+      if (kBegin != kEnd) {
+        f(kBegin, kEnd);
+      }
+    }
+  }
+
+  /**
+   * Call f with the index of every boid in the 3x3 cells around position.
+   *
+   * \param position Query position.
+   * \param f Callable taking boid index.
+   */
+  template<class F>
+  void for_each_candidate(const sf::Vector2f& position, F&& f) const {
+    for_each_candidate_range(position, [&](unsigned int begin, unsigned int end) {
+      for (unsigned int i = begin; i < end; ++i) {
+        f(indices_[i]);
+      }
+    });
+  }
+
+  /** Boid x coordinates ordered by cell, ghost copies included */
+  const std::vector<float>& sorted_x() const;
+  /** Boid y coordinates ordered by cell, ghost copies included */
+  const std::vector<float>& sorted_y() const;
+  /** Boid indices ordered by cell, ghost copies have the index of their boid */
+  const std::vector<unsigned int>& sorted_indices() const;
+
+  float cell_size() const;
+
+  /**
+   * Set cell size, takes effect on the next build().
+   *
+   * \param cell_size Cell size, the largest radius that will be queried.
+   */
+  void set_cell_size(float cell_size);
+  /** Number of ghost copies made by the last build() */
+  std::size_t ghost_count() const;
+  int columns() const;
+  int rows() const;
+
+ private:
+  void resize(const sf::Vector2f& world_size);
+  void add_ghosts(const std::vector<float>& x, const std::vector<float>& y, const sf::Vector2f& world_size);
+  void sort_into_cells(const std::vector<float>& x, const std::vector<float>& y);
+  int column(float x) const;
+  int row(float y) const;
+  /** Index of a cell in the padded grid, -1 and columns()/rows() are the ghost ring */
+  int padded_cell_index(int column, int row) const;
+
+  float cell_size_;
+  bool periodic_ = false;
+  int columns_ = 1;
+  int rows_ = 1;
+  /** Size of the interior cells, at least cell_size_ */
+  float cell_width_ = 1;
+  float cell_height_ = 1;
+  /** Padded cell of every boid, by boid index */
+  std::vector<unsigned int> cell_of_;
+  /** Ghost copies: padded cell, boid index and shifted coordinates */
+  std::vector<unsigned int> ghost_cell_;
+  std::vector<unsigned int> ghost_index_;
+  std::vector<float> ghost_x_;
+  std::vector<float> ghost_y_;
+  /** Offset of every padded cell in indices_, one extra entry marks the end */
+  std::vector<unsigned int> cell_start_;
+  /** Boid indices ordered by cell */
+  std::vector<unsigned int> indices_;
+  /** Boid coordinates ordered by cell, so candidate ranges can be scanned without gathers */
+  std::vector<float> x_;
+  std::vector<float> y_;
+};
@@ -0,0 +1,319 @@
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <iostream>
+#include <string>
+
+#include "profiler.h"
+#include "simulation.h"
+#include "trajectory.h"
+
+namespace {
+
+/** Headless run options */
+struct Options {
+  unsigned int boid_count = 10000;
+  unsigned int frame_count = 600;
+  unsigned int thread_count = 0;
+  /** Autonomous predators added at random positions */
+  unsigned int predator_count = 0;
+  /** Zero keeps the density of the default 80 boids in a 1024x768 window */
+  sf::Vector2f world_size;
+  float dt = 1.0f / 60;
+  HeadingMode heading_mode = HeadingMode::kAngle;
+  /** A loaded snapshot keeps its heading mode unless one is given */
+  bool has_heading_mode = false;
+  bool periodic_boundaries = true;
+  unsigned int spatial_sort_interval = 0;
+  NeighborSearch neighbor_search = NeighborSearch::kGrid;
+  /** Negative keeps the simulation default */
+  float verlet_skin = -1;
+  /** Zero keeps the simulation default */
+  unsigned int bucket_size = 0;
+  /** Zero keeps the simulation default */
+  int subdivisions = 0;
+  /** Zero follows every flockmate within the rule distances */
+  unsigned int topological_neighbor_count = 0;
+  bool has_seed = false;
+  std::uint64_t seed = 0;
+  /** Snapshot to start from instead of random boids, empty for none */
+  std::string load_path;
+  /** Snapshot to save after the last frame, empty for none */
+  std::string save_path;
+  /** Trajectory file recording every frame, empty for none */
+  std::string record_path;
+  /** Print per-phase percentiles over all frames */
+  bool profile = false;
+};
+
+void print_usage(const char* program) {
+  std::cout << "Usage: " << program << " [options]\n"
+            << "  --boids N        number of boids (default 10000)\n"
+            << "  --frames N       number of simulated frames (default 600)\n"
+            << "  --threads N      number of simulation threads (default all hardware threads)\n"
+            << "  --predators N    add N predators chasing the flocks (default 0)\n"
+            << "  --world W H      world size (default scaled to the boid count)\n"
+            << "  --dt SECONDS     simulation time step (default 1/60)\n"
+            << "  --heading MODE   heading representation, angle or vector (default angle)\n"
+            << "  --open-edges     do not look for neighbors across the world edges\n"
+            << "  --sort-interval N reorder boids in memory every N frames (default 0, never)\n"
+            << "  --neighbors MODE neighbor search, grid, verlet, quadtree or aggregate (default grid)\n"
+            << "  --skin S         Verlet list skin margin (default 60)\n"
+            << "  --bucket N       most boids in a quadtree leaf (default 64)\n"
+            << "  --subdivisions N aggregate grid cells per cohesion distance (default 5)\n"
+            << "  --topological K  follow only the K nearest flockmates (default 0, all within reach)\n"
+            << "  --seed N         random seed, the same seed replays a run exactly (default random)\n"
+            << "  --load PATH      start from a snapshot instead of random boids\n"
+            << "  --save PATH      save a snapshot after the last frame\n"
+            << "  --record PATH    record the trajectory of every boid\n"
+            << "  --profile        print per-phase frame time percentiles\n";
+}
+
+bool parse_options(int argc, char* argv[], Options& options) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string kArg = argv[i];
+    const bool kHasValue = i + 1 < argc;
+    if (kArg == "--boids" && kHasValue) {
+      options.boid_count = std::stoul(argv[++i]);
+    } else if (kArg == "--frames" && kHasValue) {
+      options.frame_count = std::stoul(argv[++i]);
+    } else if (kArg == "--threads" && kHasValue) {
+      options.thread_count = std::stoul(argv[++i]);
+    } else if (kArg == "--predators" && kHasValue) {
+      options.predator_count = std::stoul(argv[++i]);
+    } else if (kArg == "--world" && i + 2 < argc) {
+      options.world_size.x = std::stof(argv[++i]);
+      options.world_size.y = std::stof(argv[++i]);
+    } else if (kArg == "--dt" && kHasValue) {
+      options.dt = std::stof(argv[++i]);
+    } else if (kArg == "--heading" && kHasValue) {
+      const std::string kMode = argv[++i];
+      options.has_heading_mode = true;
+      if (kMode == "angle") {
+        options.heading_mode = HeadingMode::kAngle;
+      } else if (kMode == "vector") {
+        options.heading_mode = HeadingMode::kVector;
+      } else {
+        return false;
+      }
+    } else if (kArg == "--neighbors" && kHasValue) {
+      const std::string kMode = argv[++i];
+      if (kMode == "grid") {
+        options.neighbor_search = NeighborSearch::kGrid;
+      } else if (kMode == "verlet") {
+        options.neighbor_search = NeighborSearch::kVerletList;
+      } else if (kMode == "quadtree") {
+        options.neighbor_search = NeighborSearch::kQuadtree;
+      } else if (kMode == "aggregate") {
+        options.neighbor_search = NeighborSearch::kCellAggregates;
+      } else {
+        return false;
+      }
+    } else if (kArg == "--skin" && kHasValue) {
+      options.verlet_skin = std::stof(argv[++i]);
+    } else if (kArg == "--topological" && kHasValue) {
+      options.topological_neighbor_count = std::stoul(argv[++i]);
+    } else if (kArg == "--bucket" && kHasValue) {
+      options.bucket_size = std::stoul(argv[++i]);
+    } else if (kArg == "--subdivisions" && kHasValue) {
+      options.subdivisions = std::stoi(argv[++i]);
+    } else if (kArg == "--sort-interval" && kHasValue) {
+      options.spatial_sort_interval = std::stoul(argv[++i]);
+    } else if (kArg == "--seed" && kHasValue) {
+      options.has_seed = true;
+      options.seed = std::stoull(argv[++i]);
+    } else if (kArg == "--load" && kHasValue) {
+      options.load_path = argv[++i];
+    } else if (kArg == "--save" && kHasValue) {
+      options.save_path = argv[++i];
+    } else if (kArg == "--record" && kHasValue) {
+      options.record_path = argv[++i];
+    } else if (kArg == "--profile") {
+      options.profile = true;
+    } else if (kArg == "--open-edges") {
+      options.periodic_boundaries = false;
+    } else {
+      return false;
+    }
+  }
+
+  if (options.world_size.x <= 0 || options.world_size.y <= 0) {
+    const float kScale = std::sqrt(options.boid_count / 80.0f);
+    options.world_size = sf::Vector2f(1024 * kScale, 768 * kScale);
+  }
+
+  return true;
+}
+
+const char* neighbor_search_name(NeighborSearch neighbor_search) {
+  switch (neighbor_search) {
+    case NeighborSearch::kGrid: return "grid";
+    case NeighborSearch::kVerletList: return "verlet";
+    case NeighborSearch::kQuadtree: return "quadtree";
+    case NeighborSearch::kCellAggregates: return "aggregate";
+  }
+  return "";
+}
+
+/** FNV-1a hash of the positions and headings, equal hashes mean a run was replayed exactly */
+std::uint64_t state_hash(const Boids& boids) {
+  std::uint64_t hash = 0xcbf29ce484222325ull;
+  const auto kAdd = [&hash](float value) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    for (int byte = 0; byte < 4; ++byte) {
+      hash = (hash ^ ((bits >> (8 * byte)) & 0xff)) * 0x100000001b3ull;
+    }
+  };
+
+  for (Boids::size_type i = 0; i < boids.size(); ++i) {
+    kAdd(boids.x()[i]);
+    kAdd(boids.y()[i]);
+    kAdd(boids.rotation(i));
+  }
+  return hash;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  Options options;
+  if (!parse_options(argc, argv, options)) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  Simulation simulation(options.world_size, options.thread_count);
+  if (options.has_seed) {
+    simulation.set_seed(options.seed);
+  }
+  /** Before loading, so the update count since the last sort of a snapshot is kept */
+  simulation.set_spatial_sort_interval(options.spatial_sort_interval);
+  Predators predators;
+  try {
+    if (options.load_path.empty()) {
+      simulation.add_boids(options.boid_count);
+    } else {
+      const auto kLoadStart = std::chrono::steady_clock::now();
+      simulation.load_snapshot(options.load_path, predators);
+      const std::chrono::duration<double> kLoadElapsed = std::chrono::steady_clock::now() - kLoadStart;
+      std::cout << "snapshot load seconds: " << kLoadElapsed.count() << "\n";
+    }
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n";
+    return 1;
+  }
+
+  /** A loaded snapshot keeps its own modes unless they are given */
+  if (options.load_path.empty() || options.has_heading_mode) {
+    simulation.set_heading_mode(options.heading_mode);
+  }
+  if (!options.periodic_boundaries) {
+    simulation.set_periodic_boundaries(false);
+  }
+  simulation.set_neighbor_search(options.neighbor_search);
+  if (options.verlet_skin >= 0) {
+    simulation.set_verlet_skin(options.verlet_skin);
+  }
+  simulation.set_topological_neighbor_count(options.topological_neighbor_count);
+  simulation.add_predators(predators, options.predator_count);
+  if (options.bucket_size > 0) {
+    simulation.set_quadtree_bucket_size(options.bucket_size);
+  }
+  if (options.subdivisions > 0) {
+    simulation.set_aggregate_grid_subdivisions(options.subdivisions);
+  }
+
+  std::unique_ptr<TrajectoryRecorder> recorder;
+  if (!options.record_path.empty()) {
+    try {
+      recorder.reset(new TrajectoryRecorder(options.record_path, options.dt));
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << "\n";
+      return 1;
+    }
+  }
+
+  Profiler profiler(options.profile ? options.frame_count : 1);
+  if (options.profile) {
+    if (!Profiler::kEnabled) {
+      std::cerr << "Profiling is compiled out, build with BOIDS_PROFILING\n";
+    }
+    simulation.set_profiler(&profiler);
+  }
+
+  const auto kStart = std::chrono::steady_clock::now();
+  for (unsigned int frame = 0; frame < options.frame_count; ++frame) {
+    simulation.update(predators, options.dt);
+    if (recorder) {
+      recorder->record(simulation.boids(), simulation.world_size(), &simulation.thread_pool());
+    }
+    profiler.add(simulation.thread_pool().take_stats());
+    profiler.end_frame();
+  }
+  const std::chrono::duration<double> kElapsed = std::chrono::steady_clock::now() - kStart;
+
+  const double kSeconds = kElapsed.count();
+  const std::size_t kBoidCount = simulation.boids().size();
+  std::cout << "boids: " << kBoidCount << "\n"
+            << "frames: " << options.frame_count << "\n"
+            << "threads: " << simulation.thread_count() << "\n"
+            << "predators: " << predators.size() << "\n"
+            << "heading: " << (simulation.heading_mode() == HeadingMode::kVector ? "vector" : "angle") << "\n"
+            << "neighbors: " << neighbor_search_name(options.neighbor_search) << "\n"
+            << "flockmates: " << (simulation.topological_neighbor_count() > 0
+                                    ? std::to_string(simulation.topological_neighbor_count()) + " nearest"
+                                    : std::string("metric")) << "\n"
+            << "world: " << simulation.world_size().x << "x" << simulation.world_size().y << "\n"
+            << "seconds: " << kSeconds << "\n"
+            << "steps/sec: " << options.frame_count / kSeconds << "\n"
+            << "boid updates/sec: " << static_cast<double>(options.frame_count) * kBoidCount / kSeconds << "\n"
+            << "seed: " << simulation.seed() << "\n"
+            << "state hash: " << std::hex << state_hash(simulation.boids()) << std::dec << "\n";
+
+  if (options.neighbor_search == NeighborSearch::kQuadtree) {
+    std::cout << "quadtree bucket: " << simulation.quadtree_bucket_size() << "\n";
+  }
+
+  if (options.neighbor_search == NeighborSearch::kCellAggregates) {
+    std::cout << "aggregate grid subdivisions: " << simulation.aggregate_grid_subdivisions() << "\n";
+  }
+
+  if (options.neighbor_search == NeighborSearch::kVerletList) {
+    std::cout << "verlet builds: " << simulation.verlet_build_count() << "\n";
+  }
+
+  if (options.profile) {
+    std::cout << "profile " << profiler.report();
+  }
+
+  if (recorder) {
+    try {
+      recorder->close();
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << "\n";
+      return 1;
+    }
+    const TrajectoryRecorder::Stats kStats = recorder->stats();
+    /** Two floats for the position and one for the rotation */
+    const double kRawBytes = static_cast<double>(kStats.boid_frame_count) * 3 * sizeof(float);
+    std::cout << "recorded frames: " << kStats.frame_count - kStats.dropped_frame_count << "\n"
+              << "dropped frames: " << kStats.dropped_frame_count << "\n"
+              << "trajectory bytes: " << kStats.bytes_written << "\n"
+              << "trajectory compression vs floats: " << kRawBytes / kStats.bytes_written << "x\n";
+  }
+
+  if (!options.save_path.empty()) {
+    try {
+      simulation.save_snapshot(options.save_path, predators);
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << "\n";
+      return 1;
+    }
+  }
+
+  return 0;
+}
@@ -1,75 +1,87 @@
+#include <algorithm>
 #include <array>
-#include <random>
+#include <iostream>
+#include <memory>
 #include <SFML/Graphics.hpp>
 
 #include "arial_font.h"
 #include "predator.h"
-#include "boid.h"
+#include "profiler.h"
 #include "draw.h"
+#include "replay.h"
+#include "simulation.h"
+#include "trajectory.h"
 
 constexpr unsigned int kAddRemoveBoidsCount = 10;
 constexpr unsigned int kStartupBoidCount = 80;
+constexpr unsigned int kAddPredatorsCount = 10;
+/** Nearest flockmates in topological mode, about as many as starlings follow */
+constexpr unsigned int kTopologicalNeighborCount = 7;
 
-Boid randomize_boids(const sf::Window& window) {
-  static std::random_device rd;
-  static std::mt19937 gen(rd());
-  static std::uniform_int_distribution<> random_rotation(0, 359);
-  static std::uniform_int_distribution<> random_color_channel_value(50, 255);
-  const sf::Vector2u& window_size = window.getSize();
-  std::uniform_int_distribution<> random_pos_x(0, window_size.x);
-  std::uniform_int_distribution<> random_pos_y(0, window_size.y);
-
-  return Boid(sf::Vector2f(random_pos_x(gen), random_pos_y(gen)),
-              random_rotation(gen),
-              sf::Color(random_color_channel_value(gen),
-                        random_color_channel_value(gen),
-                        random_color_channel_value(gen)));
-}
-
-Boids randomize_boids(Boids& boids, const sf::Window& window) {
-  for (auto& boid : boids) {
-    boid = randomize_boids(window);
-  }
-
-  return boids;
-}
-
-void add_boids(Boids& boids, unsigned int count, const sf::Window& window) {
-  boids.reserve(boids.size() + count);
-  for (unsigned int i = 0; i < count; ++i) {
-    boids.push_back(randomize_boids(window));
-  }
-}
-
-void remove_boids(Boids& boids, unsigned int count) {
-  if (boids.size() > 1) {
-    const Boids::size_type kNumberOfBoidsToRemove = std::min(boids.size(), static_cast<Boids::size_type>(count));
-
-    Boids(boids.begin() + kNumberOfBoidsToRemove, boids.end()).swap(boids);
-  }
-}
-
-void update_boids(Boids& boids, const Predators& predators, const sf::Time& dt, const sf::Window& window) {
-  const sf::Vector2u& kWindowSize = window.getSize();
-  const float kDeltaTimeSeconds = dt.asSeconds();
-  for (auto& boid : boids) {
-    boid.update(boids, predators, kDeltaTimeSeconds, kWindowSize);
+int main(int argc, char* argv[]) {
+  unsigned int thread_count = 0;
+  /** Simulation steps per second */
+  float step_rate = 60;
+  /** Most simulation steps per rendered frame, time beyond that is dropped so slow frames cannot spiral */
+  unsigned int max_steps_per_frame = 5;
+  unsigned int spatial_sort_interval = 0;
+  bool has_seed = false;
+  std::uint64_t seed = 0;
+  std::string snapshot_path = "boids.snapshot";
+  std::string record_path;
+  std::string replay_path;
+  for (int i = 1; i < argc; ++i) {
+    const std::string kArg = argv[i];
+    if (kArg == "--threads" && i + 1 < argc) {
+      thread_count = std::stoul(argv[++i]);
+    } else if (kArg == "--hz" && i + 1 < argc) {
+      step_rate = std::stof(argv[++i]);
+    } else if (kArg == "--max-steps" && i + 1 < argc) {
+      max_steps_per_frame = std::max(1u, static_cast<unsigned int>(std::stoul(argv[++i])));
+    } else if (kArg == "--sort-interval" && i + 1 < argc) {
+      spatial_sort_interval = std::stoul(argv[++i]);
+    } else if (kArg == "--seed" && i + 1 < argc) {
+      has_seed = true;
+      seed = std::stoull(argv[++i]);
+    } else if (kArg == "--snapshot" && i + 1 < argc) {
+      snapshot_path = argv[++i];
+    } else if (kArg == "--record" && i + 1 < argc) {
+      record_path = argv[++i];
+    } else if (kArg == "--replay" && i + 1 < argc) {
+      replay_path = argv[++i];
+    }
   }
-}
+  const sf::Time kStep = sf::seconds(1 / step_rate);
 
-int main(int argc, char* argv[]) {
   sf::Font font;
   if (!font.loadFromMemory(kArialFont.data(), kArialFont.size())) {
     throw std::runtime_error("Cannot load font");
   }
 
   sf::RenderWindow window(sf::VideoMode(1024, 768), "Boids");
+  if (!replay_path.empty()) {
+    return run_replay(replay_path, window, font);
+  }
   window.setMouseCursorVisible(false);
 
   sf::Clock clock;
-  Boids boids(kStartupBoidCount);
-  randomize_boids(boids, window);
+  sf::Time accumulator = sf::Time::Zero;
+  Simulation simulation(sf::Vector2f(window.getSize()), thread_count);
+  if (has_seed) {
+    simulation.set_seed(seed);
+  }
+  simulation.add_boids(kStartupBoidCount);
+  simulation.set_spatial_sort_interval(spatial_sort_interval);
+  std::unique_ptr<TrajectoryRecorder> recorder;
+  if (!record_path.empty()) {
+    recorder.reset(new TrajectoryRecorder(record_path, kStep.asSeconds()));
+  }
+  Profiler profiler;
+  simulation.set_profiler(&profiler);
   Predators predators;
+  /** Predators of a frame, the mouse predator last, kept between frames so it stops allocating */
+  Predators final_predators;
+  sf::VertexArray boid_vertices(sf::Triangles);
 
   sf::Text help_text(
       std::string("Help:\n") +
@@ -77,68 +89,187 @@ int main(int argc, char* argv[]) {
         "r : randomize boids\n" +
         "+ : add " + std::to_string(kAddRemoveBoidsCount) + " boids\n" +
         "- : remove " + std::to_string(kAddRemoveBoidsCount) + " boids\n" +
-        "d : on/off debug boid drawing\n",
+        "a : add " + std::to_string(kAddPredatorsCount) + " predators chasing the flocks\n" +
+        "c : remove all chasing predators\n" +
+        "d : on/off debug boid drawing\n" +
+        "v : angle/vector heading\n" +
+        "w : on/off neighbors across edges\n" +
+        "t : metric/" + std::to_string(kTopologicalNeighborCount) + " nearest flockmates\n" +
+        "n : grid/Verlet/quadtree/aggregate neighbor search\n" +
+        "s : save snapshot\n" +
+        "l : load snapshot\n" +
+        "p : on/off profiler overlay\n",
       font);
 
+  sf::Text profile_text;
+  profile_text.setFont(font);
+  profile_text.setCharacterSize(16);
+  profile_text.setPosition(help_text.getGlobalBounds().width + 20, 0);
+
   bool debug_boid_drawing = false;
+  bool show_profile = Profiler::kEnabled;
 
   while (window.isOpen()) {
-    sf::Event event;
-    while (window.pollEvent(event)) {
-      if (event.type == sf::Event::Closed) {
-        window.close();
-      }
+    {
+      BOIDS_PROFILE_SCOPE(&profiler, ProfilePhase::kEvents);
+      sf::Event event;
+      while (window.pollEvent(event)) {
+        if (event.type == sf::Event::Closed) {
+          window.close();
+        }
 
-      if (event.type == sf::Event::Resized) {
-        window.setView(sf::View(sf::FloatRect(0, 0, event.size.width, event.size.height)));
-      }
+        if (event.type == sf::Event::Resized) {
+          simulation.set_world_size(sf::Vector2f(event.size.width, event.size.height));
+        }
 
-      if (event.type == sf::Event::KeyPressed) {
-        switch(event.key.code) {
-          case sf::Keyboard::R: {
-            randomize_boids(boids, window);
-            break;
-          }
-          case sf::Keyboard::Add: {
-            add_boids(boids, kAddRemoveBoidsCount, window);
-            break;
-          }
-          case sf::Keyboard::Subtract: {
-            remove_boids(boids, kAddRemoveBoidsCount);
-            break;
-          }
-          case sf::Keyboard::D: {
-            debug_boid_drawing = !debug_boid_drawing;
-            break;
-          }
-          default: {
-            break;
-          }
-        };
+        if (event.type == sf::Event::KeyPressed) {
+          switch(event.key.code) {
+            case sf::Keyboard::R: {
+              simulation.randomize_boids();
+              break;
+            }
+            case sf::Keyboard::Add: {
+              simulation.add_boids(kAddRemoveBoidsCount);
+              break;
+            }
+            case sf::Keyboard::Subtract: {
+              simulation.remove_boids(kAddRemoveBoidsCount);
+              break;
+            }
+            case sf::Keyboard::A: {
+              simulation.add_predators(predators, kAddPredatorsCount);
+              break;
+            }
+            case sf::Keyboard::C: {
+              predators.clear();
+              break;
+            }
+            case sf::Keyboard::D: {
+              debug_boid_drawing = !debug_boid_drawing;
+              break;
+            }
+            case sf::Keyboard::T: {
+              simulation.set_topological_neighbor_count(
+                simulation.topological_neighbor_count() == 0 ? kTopologicalNeighborCount : 0);
+              break;
+            }
+            case sf::Keyboard::W: {
+              simulation.set_periodic_boundaries(!simulation.periodic_boundaries());
+              break;
+            }
+            case sf::Keyboard::V: {
+              simulation.set_heading_mode(simulation.heading_mode() == HeadingMode::kAngle ? HeadingMode::kVector
+                                                                                           : HeadingMode::kAngle);
+              break;
+            }
+            case sf::Keyboard::N: {
+              const NeighborSearch kSearch = simulation.neighbor_search();
+              simulation.set_neighbor_search(kSearch == NeighborSearch::kGrid ? NeighborSearch::kVerletList
+                                             : kSearch == NeighborSearch::kVerletList ? NeighborSearch::kQuadtree
+                                             : kSearch == NeighborSearch::kQuadtree ? NeighborSearch::kCellAggregates
+                                                                                    : NeighborSearch::kGrid);
+              break;
+            }
+            case sf::Keyboard::P: {
+              show_profile = !show_profile;
+              break;
+            }
+            case sf::Keyboard::S: {
+              try {
+                simulation.save_snapshot(snapshot_path, predators);
+              } catch (const std::exception& e) {
+                std::cerr << e.what() << std::endl;
+              }
+              break;
+            }
+            case sf::Keyboard::L: {
+              try {
+                /** The saved world is scaled to fit the window, until resizing the window resizes the world again */
+                simulation.load_snapshot(snapshot_path, predators);
+              } catch (const std::exception& e) {
+                std::cerr << e.what() << std::endl;
+              }
+              break;
+            }
+            default: {
+              break;
+            }
+          };
+        }
       }
     }
 
     window.clear(sf::Color::Black);
 
-    const sf::Time& kDt = clock.getElapsedTime();
-    clock.restart();
+    accumulator += clock.restart();
+    const sf::Vector2f kWorldSize = simulation.world_size();
+    const sf::View kWorldView(sf::FloatRect(0, 0, kWorldSize.x, kWorldSize.y));
 
-    Predators final_predators = predators;
     {
+      BOIDS_PROFILE_SCOPE(&profiler, ProfilePhase::kPredatorGathering);
+      final_predators.clear();
+      final_predators.insert(final_predators.end(), predators.begin(), predators.end());
       Predator mouse_predator;
-      const sf::Vector2i& mouse_position = sf::Mouse::getPosition(window);
-      mouse_predator.position.x = mouse_position.x;
-      mouse_predator.position.y = mouse_position.y;
+      mouse_predator.position = window.mapPixelToCoords(sf::Mouse::getPosition(window), kWorldView);
       final_predators.push_back(mouse_predator);
     }
 
-    update_boids(boids, final_predators, kDt, window);
-    draw_boids(boids, window, debug_boid_drawing);
-    draw_predators(final_predators, window);
+    /** Fixed simulation steps, boids are drawn between the last two of them */
+    unsigned int steps = 0;
+    while (accumulator >= kStep && steps < max_steps_per_frame) {
+      simulation.update(final_predators.data(), final_predators.size(), kStep.asSeconds());
+      if (recorder) {
+        recorder->record(simulation.boids(), simulation.world_size(), &simulation.thread_pool());
+      }
+      accumulator -= kStep;
+      ++steps;
+    }
+    /** Keep where the autonomous predators went, the mouse predator is the last one */
+    std::copy(final_predators.begin(), final_predators.end() - 1, predators.begin());
+
+    if (accumulator >= kStep) {
+      accumulator = sf::microseconds(accumulator.asMicroseconds() % kStep.asMicroseconds());
+    }
 
-    window.draw(help_text);
+    BoidInterpolation interpolation;
+    interpolation.alpha = accumulator.asSeconds() / kStep.asSeconds();
+    interpolation.world_size = simulation.world_size();
+    {
+      BOIDS_PROFILE_SCOPE(&profiler, ProfilePhase::kVertexGeneration);
+      fill_boid_vertices(simulation.boids(), interpolation, debug_boid_drawing, boid_vertices,
+                         &simulation.thread_pool());
+    }
+
+    {
+      BOIDS_PROFILE_SCOPE(&profiler, ProfilePhase::kDrawCalls);
+      window.setView(kWorldView);
+      window.draw(boid_vertices);
+      draw_predators(final_predators.data(), final_predators.size(), window);
 
-    window.display();
+      const sf::Vector2f kWindowSize(window.getSize());
+      window.setView(sf::View(sf::FloatRect(0, 0, kWindowSize.x, kWindowSize.y)));
+      window.draw(help_text);
 
+      if (show_profile) {
+        profile_text.setString(profiler.report());
+        window.draw(profile_text);
+      }
+    }
+
+    {
+      BOIDS_PROFILE_SCOPE(&profiler, ProfilePhase::kDisplay);
+      window.display();
+    }
+    profiler.add(simulation.thread_pool().take_stats());
+    profiler.end_frame();
+  }
+
+  if (recorder) {
+    try {
+      recorder->close();
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
   }
 };
@@ -0,0 +1,62 @@
+#include "mapped_file.h"
+
+#include <stdexcept>
+#ifdef _WIN32
+#include <fstream>
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& path) {
+#ifdef _WIN32
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("Cannot open " + path);
+  }
+  buffer_.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  data_ = buffer_.data();
+  size_ = buffer_.size();
+#else
+  const int kFile = ::open(path.c_str(), O_RDONLY);
+  if (kFile < 0) {
+    throw std::runtime_error("Cannot open " + path);
+  }
+
+  struct stat status;
+  if (::fstat(kFile, &status) != 0 || status.st_size == 0) {
+    ::close(kFile);
+    throw std::runtime_error("Cannot read " + path + " or it is empty");
+  }
+
+  void* mapping = ::mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, kFile, 0);
+  /** The mapping stays valid after the file is closed */
+  ::close(kFile);
+  if (mapping == MAP_FAILED) {
+    throw std::runtime_error("Cannot map " + path);
+  }
+  data_ = static_cast<const unsigned char*>(mapping);
+  size_ = status.st_size;
+#endif
+
+  if (size_ == 0) {
+    throw std::runtime_error(path + " is empty");
+  }
+}
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+  ::munmap(const_cast<unsigned char*>(data_), size_);
+#endif
+}
+
+const unsigned char* MappedFile::data() const {
+  return data_;
+}
+
+std::size_t MappedFile::size() const {
+  return size_;
+}
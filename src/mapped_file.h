@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * Read only view of a whole file.
+ *
+ * The file is memory mapped, pages are only read when they are touched.
+ * Windows has no mmap, there the file is read into memory instead.
+ */
+class MappedFile {
+ public:
+  /**
+   * Map file.
+   *
+   * \param path File path.
+   * \throws std::runtime_error If the file cannot be opened or mapped, or is empty.
+   */
+  explicit MappedFile(const std::string& path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const unsigned char* data() const;
+  std::size_t size() const;
+
+ private:
+  const unsigned char* data_ = nullptr;
+  std::size_t size_ = 0;
+#ifdef _WIN32
+  std::vector<unsigned char> buffer_;
+#endif
+};
@@ -0,0 +1,180 @@
+#include "neighbor_filter.h"
+
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BOIDS_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+/** Filter candidates [first, count) one at a time, used for tails shorter than a vector */
+inline void filter_scalar_range(const float* x, const float* y, std::size_t first, std::size_t count,
+                                float px, float py, const NeighborRadii& radii, NeighborMasks& masks) {
+  for (std::size_t i = first; i < count; ++i) {
+    const float kDx = x[i] - px;
+    const float kDy = y[i] - py;
+    const float kDistanceSquared = kDx * kDx + kDy * kDy;
+    const std::uint64_t kBit = std::uint64_t(1) << i;
+    if (kDistanceSquared < radii.cohesion_squared) {
+      masks.cohesion |= kBit;
+    }
+
+    if (kDistanceSquared < radii.alignment_squared) {
+      masks.alignment |= kBit;
+    }
+
+    if (kDistanceSquared < radii.separation_squared) {
+      masks.separation |= kBit;
+    }
+  }
+}
+
+NeighborMasks filter_scalar(const float* x, const float* y, std::size_t count,
+                            float px, float py, const NeighborRadii& radii) {
+  NeighborMasks masks;
+  filter_scalar_range(x, y, 0, count, px, py, radii, masks);
+  return masks;
+}
+
+#ifdef BOIDS_X86_DISPATCH
+
+__attribute__((target("sse4.2")))
+NeighborMasks filter_sse42(const float* x, const float* y, std::size_t count,
+                           float px, float py, const NeighborRadii& radii) {
+  NeighborMasks masks;
+  const __m128 kPx = _mm_set1_ps(px);
+  const __m128 kPy = _mm_set1_ps(py);
+  const __m128 kCohesion = _mm_set1_ps(radii.cohesion_squared);
+  const __m128 kAlignment = _mm_set1_ps(radii.alignment_squared);
+  const __m128 kSeparation = _mm_set1_ps(radii.separation_squared);
+  std::size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const __m128 kDx = _mm_sub_ps(_mm_loadu_ps(x + i), kPx);
+    const __m128 kDy = _mm_sub_ps(_mm_loadu_ps(y + i), kPy);
+    const __m128 kDistanceSquared = _mm_add_ps(_mm_mul_ps(kDx, kDx), _mm_mul_ps(kDy, kDy));
+    masks.cohesion |= std::uint64_t(_mm_movemask_ps(_mm_cmplt_ps(kDistanceSquared, kCohesion))) << i;
+    masks.alignment |= std::uint64_t(_mm_movemask_ps(_mm_cmplt_ps(kDistanceSquared, kAlignment))) << i;
+    masks.separation |= std::uint64_t(_mm_movemask_ps(_mm_cmplt_ps(kDistanceSquared, kSeparation))) << i;
+  }
+  filter_scalar_range(x, y, i, count, px, py, radii, masks);
+  return masks;
+}
+
+__attribute__((target("avx2")))
+NeighborMasks filter_avx2(const float* x, const float* y, std::size_t count,
+                          float px, float py, const NeighborRadii& radii) {
+  NeighborMasks masks;
+  const __m256 kPx = _mm256_set1_ps(px);
+  const __m256 kPy = _mm256_set1_ps(py);
+  const __m256 kCohesion = _mm256_set1_ps(radii.cohesion_squared);
+  const __m256 kAlignment = _mm256_set1_ps(radii.alignment_squared);
+  const __m256 kSeparation = _mm256_set1_ps(radii.separation_squared);
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m256 kDx = _mm256_sub_ps(_mm256_loadu_ps(x + i), kPx);
+    const __m256 kDy = _mm256_sub_ps(_mm256_loadu_ps(y + i), kPy);
+    const __m256 kDistanceSquared = _mm256_add_ps(_mm256_mul_ps(kDx, kDx), _mm256_mul_ps(kDy, kDy));
+    masks.cohesion |=
+      std::uint64_t(_mm256_movemask_ps(_mm256_cmp_ps(kDistanceSquared, kCohesion, _CMP_LT_OQ))) << i;
+    masks.alignment |=
+      std::uint64_t(_mm256_movemask_ps(_mm256_cmp_ps(kDistanceSquared, kAlignment, _CMP_LT_OQ))) << i;
+    masks.separation |=
+      std::uint64_t(_mm256_movemask_ps(_mm256_cmp_ps(kDistanceSquared, kSeparation, _CMP_LT_OQ))) << i;
+  }
+  filter_scalar_range(x, y, i, count, px, py, radii, masks);
+  return masks;
+}
+
+__attribute__((target("avx512f")))
+NeighborMasks filter_avx512(const float* x, const float* y, std::size_t count,
+                            float px, float py, const NeighborRadii& radii) {
+  NeighborMasks masks;
+  const __m512 kPx = _mm512_set1_ps(px);
+  const __m512 kPy = _mm512_set1_ps(py);
+  const __m512 kCohesion = _mm512_set1_ps(radii.cohesion_squared);
+  const __m512 kAlignment = _mm512_set1_ps(radii.alignment_squared);
+  const __m512 kSeparation = _mm512_set1_ps(radii.separation_squared);
+  std::size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const __m512 kDx = _mm512_sub_ps(_mm512_loadu_ps(x + i), kPx);
+    const __m512 kDy = _mm512_sub_ps(_mm512_loadu_ps(y + i), kPy);
+    const __m512 kDistanceSquared = _mm512_add_ps(_mm512_mul_ps(kDx, kDx), _mm512_mul_ps(kDy, kDy));
+    masks.cohesion |= std::uint64_t(_mm512_cmp_ps_mask(kDistanceSquared, kCohesion, _CMP_LT_OQ)) << i;
+    masks.alignment |= std::uint64_t(_mm512_cmp_ps_mask(kDistanceSquared, kAlignment, _CMP_LT_OQ)) << i;
+    masks.separation |= std::uint64_t(_mm512_cmp_ps_mask(kDistanceSquared, kSeparation, _CMP_LT_OQ)) << i;
+  }
+  filter_scalar_range(x, y, i, count, px, py, radii, masks);
+  return masks;
+}
+
+#endif
+
+}
+
+SimdLevel detect_simd_level() {
+#ifdef BOIDS_X86_DISPATCH
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return SimdLevel::kAvx512;
+  }
+
+  if (__builtin_cpu_supports("avx2")) {
+    return SimdLevel::kAvx2;
+  }
+
+  if (__builtin_cpu_supports("sse4.2")) {
+    return SimdLevel::kSse42;
+  }
+#endif
+
+  return SimdLevel::kScalar;
+}
+
+const char* to_string(SimdLevel level) {
+  switch (level) {
+    case SimdLevel::kScalar: {
+      return "scalar";
+    }
+    case SimdLevel::kSse42: {
+      return "sse4.2";
+    }
+    case SimdLevel::kAvx2: {
+      return "avx2";
+    }
+    case SimdLevel::kAvx512: {
+      return "avx512";
+    }
+  }
+
+  return "unknown";
+}
+
+NeighborFilter get_neighbor_filter(SimdLevel level) {
+#ifdef BOIDS_X86_DISPATCH
+  switch (std::min(level, detect_simd_level())) {
+    case SimdLevel::kAvx512: {
+      return filter_avx512;
+    }
+    case SimdLevel::kAvx2: {
+      return filter_avx2;
+    }
+    case SimdLevel::kSse42: {
+      return filter_sse42;
+    }
+    case SimdLevel::kScalar: {
+      break;
+    }
+  }
+#else
+  (void)level;
+#endif
+
+  return filter_scalar;
+}
+
+NeighborFilter get_neighbor_filter() {
+  static const NeighborFilter kFilter = get_neighbor_filter(detect_simd_level());
+  return kFilter;
+}
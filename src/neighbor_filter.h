@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/** Instruction sets the neighbor filter has kernels for */
+enum class SimdLevel {
+  kScalar,
+  kSse42,
+  kAvx2,
+  kAvx512,
+};
+
+/** Maximum number of candidates one filter call handles */
+constexpr std::size_t kNeighborFilterBlockSize = 64;
+
+/** Squared rule distances, each one not larger than the previous */
+struct NeighborRadii {
+  float cohesion_squared;
+  float alignment_squared;
+  float separation_squared;
+};
+
+/** Bit i is set if candidate i is closer than the rule distance */
+struct NeighborMasks {
+  std::uint64_t cohesion = 0;
+  std::uint64_t alignment = 0;
+  std::uint64_t separation = 0;
+};
+
+/**
+ * Neighbor filter kernel.
+ *
+ * Compares squared distances from (px, py) to count candidates against all
+ * three rule distances.
+ *
+ * \param x Candidate x coordinates.
+ * \param y Candidate y coordinates.
+ * \param count Number of candidates, at most kNeighborFilterBlockSize.
+ * \param px Query x coordinate.
+ * \param py Query y coordinate.
+ * \param radii Squared rule distances.
+ * \return Masks of candidates within each distance.
+ */
+using NeighborFilter = NeighborMasks (*)(const float* x, const float* y, std::size_t count,
+                                         float px, float py, const NeighborRadii& radii);
+
+/** Best instruction set supported by the running CPU. */
+SimdLevel detect_simd_level();
+
+const char* to_string(SimdLevel level);
+
+/**
+ * Get neighbor filter kernel for an instruction set.
+ *
+ * \param level Instruction set, falls back to the best supported one below it.
+ */
+NeighborFilter get_neighbor_filter(SimdLevel level);
+
+/** Get neighbor filter kernel for the running CPU, detected once. */
+NeighborFilter get_neighbor_filter();
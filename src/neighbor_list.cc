@@ -0,0 +1,117 @@
+#include "neighbor_list.h"
+
+#include <algorithm>
+#include "neighbor_filter.h"
+#include "utils.h"
+
+NeighborList::NeighborList(float skin)
+  : skin_(skin) {}
+
+float NeighborList::skin() const {
+  return skin_;
+}
+
+void NeighborList::set_skin(float skin) {
+  skin_ = skin;
+  invalidate();
+}
+
+void NeighborList::build(const Grid& grid, const std::vector<float>& x, const std::vector<float>& y, float radius,
+                         const sf::Vector2f& world_size, ThreadPool& thread_pool) {
+  const float kRadius = radius + skin_;
+  const NeighborRadii kRadii = {kRadius * kRadius, kRadius * kRadius, kRadius * kRadius};
+  const NeighborFilter kFilter = get_neighbor_filter();
+  const std::vector<float>& kSortedX = grid.sorted_x();
+  const std::vector<float>& kSortedY = grid.sorted_y();
+  const std::vector<unsigned int>& kSortedIndices = grid.sorted_indices();
+
+  const auto kForEachNeighbor = [&](std::size_t index, auto&& f) {
+    const sf::Vector2f kPosition(x[index], y[index]);
+    grid.for_each_candidate_range(kPosition, [&](unsigned int begin, unsigned int end) {
+      for (unsigned int block = begin; block < end; block += kNeighborFilterBlockSize) {
+        const std::size_t kCount = std::min<std::size_t>(end - block, kNeighborFilterBlockSize);
+        const NeighborMasks kMasks =
+          kFilter(&kSortedX[block], &kSortedY[block], kCount, kPosition.x, kPosition.y, kRadii);
+        for (std::uint64_t mask = kMasks.cohesion; mask != 0; mask &= mask - 1) {
+          const unsigned int kOther = kSortedIndices[block + __builtin_ctzll(mask)];
+          if (kOther != index) {
+            f(kOther);
+          }
+        }
+      }
+    });
+  };
+
+  /** Count neighbors first, so the lists of all boids can be written in parallel into one array */
+  offsets_.assign(x.size() + 1, 0);
+  thread_pool.parallel_for(x.size(), [&](std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i) {
+      unsigned int count = 0;
+      kForEachNeighbor(i, [&count](unsigned int) { ++count; });
+      offsets_[i + 1] = count;
+    }
+  });
+
+  for (std::size_t i = 1; i < offsets_.size(); ++i) {
+    offsets_[i] += offsets_[i - 1];
+  }
+
+  neighbors_.resize(offsets_.back());
+  thread_pool.parallel_for(x.size(), [&](std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i) {
+      unsigned int* neighbor = neighbors_.data() + offsets_[i];
+      kForEachNeighbor(i, [&neighbor](unsigned int other) { *neighbor++ = other; });
+    }
+  });
+
+  reference_x_ = x;
+  reference_y_ = y;
+  periodic_ = grid.periodic();
+  world_size_ = world_size;
+  valid_ = true;
+  ++build_count_;
+}
+
+bool NeighborList::needs_rebuild(const std::vector<float>& x, const std::vector<float>& y) const {
+  if (!valid_ || x.size() != reference_x_.size()) {
+    return true;
+  }
+
+  const float kLimitSquared = skin_ * skin_ / 4;
+  for (std::size_t i = 0; i < x.size(); ++i) {
+    sf::Vector2f displacement(x[i] - reference_x_[i], y[i] - reference_y_[i]);
+    /** Crossing a wrapping edge is a small step, in open mode it is a jump that needs a rebuild */
+    if (periodic_) {
+      displacement = minimum_image_2d(displacement, world_size_);
+    }
+
+    if (displacement.x * displacement.x + displacement.y * displacement.y > kLimitSquared) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void NeighborList::invalidate() {
+  valid_ = false;
+}
+
+const unsigned int* NeighborList::begin(std::size_t index) const {
+  return neighbors_.data() + offsets_[index];
+}
+
+const unsigned int* NeighborList::end(std::size_t index) const {
+  return neighbors_.data() + offsets_[index + 1];
+}
+
+bool NeighborList::periodic() const {
+  return periodic_;
+}
+
+const sf::Vector2f& NeighborList::world_size() const {
+  return world_size_;
+}
+
+std::size_t NeighborList::build_count() const {
+  return build_count_;
+}
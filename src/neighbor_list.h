@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vector>
+#include <SFML/System/Vector2.hpp>
+#include "grid.h"
+#include "thread_pool.h"
+
+/**
+ * Verlet neighbor lists.
+ *
+ * Stores the neighbors of every boid within the query radius plus a skin
+ * margin. As long as no boid has moved more than half the skin since the
+ * lists were built, every boid within the query radius is still in them, so
+ * the lists can be reused instead of searching the grid every frame.
+ */
+class NeighborList {
+ public:
+  /**
+   * Create empty lists, they need a build() before use.
+   *
+   * \param skin Skin margin added to the query radius.
+   */
+  explicit NeighborList(float skin);
+
+  float skin() const;
+
+  /**
+   * Set skin margin, invalidates the lists.
+   *
+   * \param skin Skin margin added to the query radius.
+   */
+  void set_skin(float skin);
+
+  /**
+   * Rebuild lists.
+   *
+   * \param grid Spatial index of the positions, built with cell size of at least radius + skin().
+   * \param x X coordinates of all boids.
+   * \param y Y coordinates of all boids.
+   * \param radius Query radius.
+   * \param world_size World size, used for minimum image distances if the grid is periodic.
+   * \param thread_pool Thread pool to build lists of different boids on.
+   */
+  void build(const Grid& grid, const std::vector<float>& x, const std::vector<float>& y, float radius,
+             const sf::Vector2f& world_size, ThreadPool& thread_pool);
+
+  /**
+   * Check if lists have to be rebuilt.
+   *
+   * \param x X coordinates of all boids.
+   * \param y Y coordinates of all boids.
+   * \return True if the lists were invalidated, the boid count changed or some
+   *         boid moved more than half the skin since the last build.
+   */
+  bool needs_rebuild(const std::vector<float>& x, const std::vector<float>& y) const;
+
+  /** Force a rebuild, needed whenever boid indices change. */
+  void invalidate();
+
+  /**
+   * Get neighbors of boid.
+   *
+   * \param index Boid index.
+   * \return Pointer to the first neighbor index, the boid itself is not included.
+   */
+  const unsigned int* begin(std::size_t index) const;
+  const unsigned int* end(std::size_t index) const;
+
+  bool periodic() const;
+  /** World size at the last build */
+  const sf::Vector2f& world_size() const;
+  /** Number of builds so far */
+  std::size_t build_count() const;
+
+ private:
+  float skin_;
+  bool valid_ = false;
+  bool periodic_ = false;
+  sf::Vector2f world_size_;
+  std::size_t build_count_ = 0;
+  /** Offset of the neighbors of every boid in neighbors_, one extra entry marks the end */
+  std::vector<unsigned int> offsets_;
+  std::vector<unsigned int> neighbors_;
+  /** Positions at the last build */
+  std::vector<float> reference_x_;
+  std::vector<float> reference_y_;
+};
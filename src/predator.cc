@@ -0,0 +1,113 @@
+#include "predator.h"
+
+#include <algorithm>
+#include <cmath>
+#include "utils.h"
+
+const Predator::Config Predator::kConfig_;
+
+constexpr std::size_t PredatorIndex::kGridThreshold;
+
+void Predator::update(const FlockCenters& flocks, float dt, const sf::Vector2f& world_size) {
+  if (!autonomous) {
+    return;
+  }
+
+  sf::Vector2f center;
+  if (flocks.center_of_mass(position, center)) {
+    const sf::Vector2f kToFlock = center - position;
+    const float kDistance = length_2d(kToFlock);
+    if (kDistance > 0) {
+      const sf::Vector2f kChaseVelocity = kToFlock * (kConfig_.kChaseSpeed / kDistance);
+      velocity += (kChaseVelocity - velocity) * std::min(1.0f, kConfig_.kSteeringRate * dt);
+    }
+  }
+
+  position += velocity * dt;
+  position.x = std::fmod(position.x + world_size.x, world_size.x);
+  position.y = std::fmod(position.y + world_size.y, world_size.y);
+}
+
+FlockCenters::FlockCenters(float cell_size)
+  : cell_size_(cell_size) {}
+
+void FlockCenters::build(const std::vector<float>& x, const std::vector<float>& y, const sf::Vector2f& world_size) {
+  /** Whole cells per axis, so neighbor cells across an edge line up like in the grid */
+  columns_ = std::max(1, static_cast<int>(world_size.x / cell_size_));
+  rows_ = std::max(1, static_cast<int>(world_size.y / cell_size_));
+  cell_dimensions_ = sf::Vector2f(world_size.x / columns_, world_size.y / rows_);
+  world_size_ = world_size;
+  cells_.assign(columns_ * rows_, Cell());
+  for (std::size_t i = 0; i < x.size(); ++i) {
+    Cell& cell = cells_[row(y[i]) * columns_ + column(x[i])];
+    ++cell.count;
+    cell.position_sum += sf::Vector2f(x[i], y[i]);
+  }
+}
+
+bool FlockCenters::center_of_mass(const sf::Vector2f& position, sf::Vector2f& center) const {
+  const int kColumn = column(position.x);
+  const int kRow = row(position.y);
+  /** With fewer than three cells on an axis every cell of it is around the position, and counts once */
+  const int kFirstColumn = columns_ < 3 ? 0 : kColumn - 1;
+  const int kLastColumn = columns_ < 3 ? columns_ - 1 : kColumn + 1;
+  const int kFirstRow = rows_ < 3 ? 0 : kRow - 1;
+  const int kLastRow = rows_ < 3 ? rows_ - 1 : kRow + 1;
+  int count = 0;
+  sf::Vector2f position_sum;
+  for (int r = kFirstRow; r <= kLastRow; ++r) {
+    const int kWrappedRow = (r + rows_) % rows_;
+    for (int c = kFirstColumn; c <= kLastColumn; ++c) {
+      const int kWrappedColumn = (c + columns_) % columns_;
+      const Cell& kCell = cells_[kWrappedRow * columns_ + kWrappedColumn];
+      if (kCell.count == 0) {
+        continue;
+      }
+
+      /** Cells across an edge are moved to the side of the position, like ghost cells */
+      const sf::Vector2f kCellCenter((kWrappedColumn + 0.5f) * cell_dimensions_.x,
+                                     (kWrappedRow + 0.5f) * cell_dimensions_.y);
+      const sf::Vector2f kShift = minimum_image_2d(kCellCenter - position, world_size_) - (kCellCenter - position);
+      count += kCell.count;
+      position_sum += kCell.position_sum + kShift * static_cast<float>(kCell.count);
+    }
+  }
+
+  if (count == 0) {
+    return false;
+  }
+  center = position_sum / static_cast<float>(count);
+  return true;
+}
+
+int FlockCenters::column(float x) const {
+  return std::min(std::max(static_cast<int>(x / cell_dimensions_.x), 0), columns_ - 1);
+}
+
+int FlockCenters::row(float y) const {
+  return std::min(std::max(static_cast<int>(y / cell_dimensions_.y), 0), rows_ - 1);
+}
+
+PredatorIndex::PredatorIndex()
+  : grid_(1) {}
+
+void PredatorIndex::build(const Predator* predators, std::size_t predator_count, float reach,
+                          const sf::Vector2f& world_size) {
+  predators_ = predators;
+  predator_count_ = predator_count;
+  if (predator_count < kGridThreshold) {
+    return;
+  }
+
+  /** Predators of any size have to be within the 3x3 cells around a boid that sees them */
+  int max_size = 0;
+  x_.resize(predator_count);
+  y_.resize(predator_count);
+  for (std::size_t i = 0; i < predator_count; ++i) {
+    x_[i] = predators[i].position.x;
+    y_[i] = predators[i].position.y;
+    max_size = std::max(max_size, predators[i].size);
+  }
+  grid_.set_cell_size(reach + max_size);
+  grid_.build(x_, y_, world_size);
+}
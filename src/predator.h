@@ -1,10 +1,148 @@
 #pragma once
 
-#include <SFML/System.hpp>
+#include <vector>
+#include <SFML/System/Vector2.hpp>
+#include "grid.h"
+
+class FlockCenters;
 
 struct Predator {
+  /** Predator config options */
+  struct Config {
+    /** Autonomous predators see flocks this far */
+    const float kSightDistance = 400;
+    /** Between the cruising and the escape speed of boids */
+    const float kChaseSpeed = 300;
+    /** Share of the way to the chase velocity turned per second */
+    const float kSteeringRate = 2;
+  };
+
+  static const Config kConfig_;
+
   sf::Vector2f position;
+  /** Velocity of an autonomous predator in pixels per second */
+  sf::Vector2f velocity;
   int size = 20;
+  /** Autonomous predators chase flocks on their own, others are moved from outside like the mouse predator */
+  bool autonomous = false;
+
+  /**
+   * Steer autonomous predator towards the center of mass of the boids in sight and move it.
+   *
+   * Predators that see no boids keep going straight. They wrap around the
+   * world edges like boids.
+   *
+   * \param flocks Boid counts and position sums of the last update.
+   * \param dt Delta time in seconds.
+   * \param world_size World size.
+   */
+  void update(const FlockCenters& flocks, float dt, const sf::Vector2f& world_size);
 };
 
 using Predators = std::vector<Predator>;
+
+/**
+ * Coarse grid of boid counts and position sums, for predators to find flocks.
+ *
+ * Built once per update, so every predator looks at the 3x3 cells around it
+ * instead of at every boid. Cells are at least the sight distance wide, and
+ * wrap around the world edges.
+ */
+class FlockCenters {
+ public:
+  /**
+   * Create flock centers.
+   *
+   * \param cell_size Smallest cell size.
+   */
+  explicit FlockCenters(float cell_size = Predator::kConfig_.kSightDistance);
+
+  /**
+   * Rebuild counts and sums.
+   *
+   * \param x X coordinates of all boids.
+   * \param y Y coordinates of all boids.
+   * \param world_size World size.
+   */
+  void build(const std::vector<float>& x, const std::vector<float>& y, const sf::Vector2f& world_size);
+
+  /**
+   * Get center of mass of the boids in the 3x3 cells around a position.
+   *
+   * Cells across a world edge count at their position on the side of the
+   * query, so the center can lie outside the world.
+   *
+   * \param position Query position.
+   * \param center Center of mass, set if there are boids.
+   * \return False if there are no boids around position.
+   */
+  bool center_of_mass(const sf::Vector2f& position, sf::Vector2f& center) const;
+
+ private:
+  struct Cell {
+    int count = 0;
+    sf::Vector2f position_sum;
+  };
+
+  int column(float x) const;
+  int row(float y) const;
+
+  float cell_size_;
+  int columns_ = 1;
+  int rows_ = 1;
+  sf::Vector2f cell_dimensions_ = sf::Vector2f(1, 1);
+  sf::Vector2f world_size_;
+  std::vector<Cell> cells_;
+};
+
+/**
+ * Predators as seen by the boids.
+ *
+ * A handful of predators is scanned as it is. More are bucketed into a grid
+ * built once per update, so every boid looks at the predators around it
+ * instead of at every predator.
+ */
+class PredatorIndex {
+ public:
+  /** Fewer predators are scanned without the grid, in their order */
+  static constexpr std::size_t kGridThreshold = 16;
+
+  PredatorIndex();
+
+  /**
+   * Rebuild index.
+   *
+   * \param predators Predators, must stay unchanged while the index is used.
+   * \param predator_count Number of predators.
+   * \param reach Largest distance a predator is seen from, its size not included.
+   * \param world_size World size.
+   */
+  void build(const Predator* predators, std::size_t predator_count, float reach, const sf::Vector2f& world_size);
+
+  /**
+   * Call f with every predator that can be within reach of position, and maybe others.
+   *
+   * \param position Query position.
+   * \param f Callable taking a const Predator&.
+   */
+  template<class F>
+  void for_each_candidate(const sf::Vector2f& position, F&& f) const {
+    if (predator_count_ < kGridThreshold) {
+      for (std::size_t i = 0; i < predator_count_; ++i) {
+        f(predators_[i]);
+      }
+      return;
+    }
+
+    grid_.for_each_candidate(position, [&](unsigned int index) {
+      f(predators_[index]);
+    });
+  }
+
+ private:
+  const Predator* predators_ = nullptr;
+  std::size_t predator_count_ = 0;
+  Grid grid_;
+  std::vector<float> x_;
+  std::vector<float> y_;
+};
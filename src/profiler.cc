@@ -0,0 +1,145 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+
+Profiler::Profiler(std::size_t window_size)
+  : window_size_(std::max<std::size_t>(1, window_size)) {
+  for (auto& time : running_) {
+    time = 0;
+  }
+  frames_.reserve(window_size_);
+  pool_frames_.reserve(window_size_);
+}
+
+void Profiler::add(ProfilePhase phase, Clock::duration duration) {
+  running_[static_cast<std::size_t>(phase)].fetch_add(duration.count(), std::memory_order_relaxed);
+}
+
+void Profiler::add(const ThreadPool::Stats& stats) {
+  running_pool_.job_count += stats.job_count;
+  running_pool_.job_time += stats.job_time;
+  running_pool_.workers.resize(std::max(running_pool_.workers.size(), stats.workers.size()));
+  for (std::size_t i = 0; i < stats.workers.size(); ++i) {
+    ThreadPool::WorkerStats& worker = running_pool_.workers[i];
+    worker.busy_time += stats.workers[i].busy_time;
+    worker.chunk_count += stats.workers[i].chunk_count;
+    worker.steal_count += stats.workers[i].steal_count;
+  }
+}
+
+void Profiler::end_frame() {
+  std::array<float, kPhaseCount> frame;
+  for (std::size_t i = 0; i < kPhaseCount; ++i) {
+    const Clock::duration kTime(running_[i].exchange(0, std::memory_order_relaxed));
+    frame[i] = std::chrono::duration<float, std::milli>(kTime).count();
+  }
+
+  if (frames_.size() < window_size_) {
+    frames_.push_back(frame);
+    pool_frames_.push_back(ThreadPool::Stats());
+  } else {
+    frames_[next_frame_] = frame;
+  }
+  pool_frames_[next_frame_] = std::move(running_pool_);
+  running_pool_ = ThreadPool::Stats();
+  next_frame_ = (next_frame_ + 1) % window_size_;
+}
+
+std::size_t Profiler::frame_count() const {
+  return frames_.size();
+}
+
+Profiler::Summary Profiler::summary(ProfilePhase phase) const {
+  Summary summary;
+  if (frames_.empty()) {
+    return summary;
+  }
+
+  std::vector<float> times;
+  times.reserve(frames_.size());
+  double sum = 0;
+  for (const auto& frame : frames_) {
+    times.push_back(frame[static_cast<std::size_t>(phase)]);
+    sum += times.back();
+  }
+  std::sort(times.begin(), times.end());
+
+  /** Nearest rank */
+  const auto kPercentile = [&times](double percent) {
+    const std::size_t kRank = static_cast<std::size_t>(percent / 100 * times.size() + 0.5);
+    return times[std::min(times.size() - 1, std::max<std::size_t>(1, kRank) - 1)];
+  };
+  summary.p50 = kPercentile(50);
+  summary.p90 = kPercentile(90);
+  summary.p99 = kPercentile(99);
+  summary.mean = sum / times.size();
+  return summary;
+}
+
+const char* Profiler::name(ProfilePhase phase) {
+  switch (phase) {
+    case ProfilePhase::kEvents: return "events";
+    case ProfilePhase::kPredatorGathering: return "predator gathering";
+    case ProfilePhase::kPredatorUpdate: return "predator update";
+    case ProfilePhase::kSpatialSort: return "spatial sort";
+    case ProfilePhase::kNeighborIndex: return "neighbor index";
+    case ProfilePhase::kBoidUpdate: return "boid update";
+    case ProfilePhase::kNeighborSearch: return "  neighbor search";
+    case ProfilePhase::kRuleEvaluation: return "  rule evaluation";
+    case ProfilePhase::kIntegration: return "  integration";
+    case ProfilePhase::kVertexGeneration: return "vertex generation";
+    case ProfilePhase::kDrawCalls: return "draw calls";
+    case ProfilePhase::kDisplay: return "display";
+    case ProfilePhase::kCount: break;
+  }
+  return "";
+}
+
+std::vector<Profiler::WorkerSummary> Profiler::worker_summaries() const {
+  Clock::duration job_time = Clock::duration::zero();
+  std::vector<ThreadPool::WorkerStats> workers;
+  for (const auto& frame : pool_frames_) {
+    job_time += frame.job_time;
+    workers.resize(std::max(workers.size(), frame.workers.size()));
+    for (std::size_t i = 0; i < frame.workers.size(); ++i) {
+      workers[i].busy_time += frame.workers[i].busy_time;
+      workers[i].chunk_count += frame.workers[i].chunk_count;
+      workers[i].steal_count += frame.workers[i].steal_count;
+    }
+  }
+
+  std::vector<WorkerSummary> summaries(workers.size());
+  for (std::size_t i = 0; i < workers.size(); ++i) {
+    if (job_time > Clock::duration::zero()) {
+      summaries[i].utilization = std::chrono::duration<double>(workers[i].busy_time) /
+                                 std::chrono::duration<double>(job_time);
+    }
+    summaries[i].chunks_per_frame = static_cast<double>(workers[i].chunk_count) / pool_frames_.size();
+    summaries[i].steals_per_frame = static_cast<double>(workers[i].steal_count) / pool_frames_.size();
+  }
+  return summaries;
+}
+
+std::string Profiler::report() const {
+  std::string report = "ms over " + std::to_string(frame_count()) + " frames: p50 / p90 / p99\n";
+  for (std::size_t i = 0; i < kPhaseCount; ++i) {
+    const ProfilePhase kPhase = static_cast<ProfilePhase>(i);
+    const Summary kSummary = summary(kPhase);
+    char line[128];
+    std::snprintf(line, sizeof(line), "%s: %.3f / %.3f / %.3f\n", name(kPhase), kSummary.p50, kSummary.p90,
+                  kSummary.p99);
+    report += line;
+  }
+
+  const std::vector<WorkerSummary> kWorkers = worker_summaries();
+  for (std::size_t i = 0; i < kWorkers.size(); ++i) {
+    char line[128];
+    /** The calling thread is the last worker */
+    const std::string kName = i + 1 < kWorkers.size() ? "worker " + std::to_string(i) : "calling thread";
+    std::snprintf(line, sizeof(line), "%s: %.0f%% busy, %.1f chunks, %.1f steals per frame\n", kName.c_str(),
+                  kWorkers[i].utilization * 100, kWorkers[i].chunks_per_frame, kWorkers[i].steals_per_frame);
+    report += line;
+  }
+  return report;
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "thread_pool.h"
+
+/** Parts of a frame timed by the Profiler */
+enum class ProfilePhase {
+  kEvents,
+  /** Building the per-frame predator list */
+  kPredatorGathering,
+  /** Moving autonomous predators and indexing all predators */
+  kPredatorUpdate,
+  kSpatialSort,
+  /** Grid or Verlet list build */
+  kNeighborIndex,
+  /** Wall time of updating all boids, the next three phases are the parts of it */
+  kBoidUpdate,
+  kNeighborSearch,
+  /** Flocking rules and predator avoidance */
+  kRuleEvaluation,
+  kIntegration,
+  kVertexGeneration,
+  kDrawCalls,
+  kDisplay,
+  kCount,
+};
+
+/**
+ * Per-phase frame timer with rolling percentiles.
+ *
+ * Phase times of the running frame are summed up until end_frame() moves
+ * them into a window of the last frames. add() may be called from several
+ * threads, everything else only from the thread owning the profiler.
+ *
+ * Work of the thread pool is added once per frame too, for the share of
+ * the pool's time every thread spent working and how often it stole work.
+ *
+ * Timing code is compiled in with the BOIDS_PROFILING definition, without
+ * it BOIDS_PROFILE_SCOPE does nothing and the simulation takes no samples.
+ */
+class Profiler {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+#ifdef BOIDS_PROFILING
+  static constexpr bool kEnabled = true;
+#else
+  static constexpr bool kEnabled = false;
+#endif
+
+  /** Percentiles of one phase over the window, in milliseconds */
+  struct Summary {
+    double p50 = 0;
+    double p90 = 0;
+    double p99 = 0;
+    double mean = 0;
+  };
+
+  /** Work of one pool thread over the window */
+  struct WorkerSummary {
+    /** Share of the pool's job time the thread ran chunks, 0 to 1 */
+    double utilization = 0;
+    double chunks_per_frame = 0;
+    double steals_per_frame = 0;
+  };
+
+  /**
+   * Create profiler.
+   *
+   * \param window_size Number of frames percentiles are taken over.
+   */
+  explicit Profiler(std::size_t window_size = 120);
+
+  Profiler(const Profiler&) = delete;
+  Profiler& operator=(const Profiler&) = delete;
+
+  /**
+   * Add time to a phase of the running frame, thread safe.
+   *
+   * \param phase Phase.
+   * \param duration Time spent.
+   */
+  void add(ProfilePhase phase, Clock::duration duration);
+
+  /**
+   * Add work of a thread pool to the running frame.
+   *
+   * \param stats Stats taken from the pool, see ThreadPool::take_stats().
+   */
+  void add(const ThreadPool::Stats& stats);
+
+  /** Finish running frame, its phase times replace the oldest frame of the window. */
+  void end_frame();
+
+  /** Frames in the window so far */
+  std::size_t frame_count() const;
+
+  /**
+   * Get percentiles of a phase.
+   *
+   * \param phase Phase.
+   */
+  Summary summary(ProfilePhase phase) const;
+
+  /**
+   * Get phase name.
+   *
+   * \param phase Phase.
+   */
+  static const char* name(ProfilePhase phase);
+
+  /** Work of every pool thread over the window, the calling thread last */
+  std::vector<WorkerSummary> worker_summaries() const;
+
+  /** One line per phase with its percentiles and one per pool thread, for overlays and logs */
+  std::string report() const;
+
+ private:
+  static constexpr std::size_t kPhaseCount = static_cast<std::size_t>(ProfilePhase::kCount);
+
+  std::size_t window_size_;
+  /** Running frame, in clock ticks */
+  std::array<std::atomic<Clock::rep>, kPhaseCount> running_;
+  /** Window of finished frames in milliseconds, frame after frame */
+  std::vector<std::array<float, kPhaseCount>> frames_;
+  /** Thread pool work of the running frame */
+  ThreadPool::Stats running_pool_;
+  /** Thread pool work of the frames in the window, same order as frames_ */
+  std::vector<ThreadPool::Stats> pool_frames_;
+  std::size_t next_frame_ = 0;
+};
+
+/** Adds the time from construction to destruction to a profiler phase */
+class ScopedTimer {
+ public:
+  /**
+   * Start timer.
+   *
+   * \param profiler Profiler, null disables the timer.
+   * \param phase Phase.
+   */
+  ScopedTimer(Profiler* profiler, ProfilePhase phase)
+    : profiler_(profiler),
+      phase_(phase),
+      start_(profiler != nullptr ? Profiler::Clock::now() : Profiler::Clock::time_point()) {}
+
+  ~ScopedTimer() {
+    if (profiler_ != nullptr) {
+      profiler_->add(phase_, Profiler::Clock::now() - start_);
+    }
+  }
+
+  ScopedTimer(const ScopedTimer&) = delete;
+  ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+ private:
+  Profiler* profiler_;
+  ProfilePhase phase_;
+  Profiler::Clock::time_point start_;
+};
+
+#define BOIDS_PROFILE_CONCAT_IMPL(a, b) a##b
+#define BOIDS_PROFILE_CONCAT(a, b) BOIDS_PROFILE_CONCAT_IMPL(a, b)
+
+/** Time the rest of the enclosing scope, profiler may be null */
+#ifdef BOIDS_PROFILING
+#define BOIDS_PROFILE_SCOPE(profiler, phase) \
+  const ScopedTimer BOIDS_PROFILE_CONCAT(profile_scope_, __LINE__)((profiler), (phase))
+#else
+#define BOIDS_PROFILE_SCOPE(profiler, phase) static_cast<void>(0)
+#endif
@@ -0,0 +1,237 @@
+#include "quadtree.h"
+
+#include "spatial_order.h"
+#include "thread_pool.h"
+
+constexpr int Quadtree::kMaxDepth;
+constexpr int Quadtree::kMaxEntryDepth;
+constexpr std::uint32_t Quadtree::kNoNode;
+
+Quadtree::Quadtree(float radius, unsigned int bucket_size)
+  : radius_(radius),
+    bucket_size_(std::max(1u, bucket_size)) {}
+
+bool Quadtree::periodic() const {
+  return periodic_;
+}
+
+void Quadtree::set_periodic(bool periodic) {
+  periodic_ = periodic;
+}
+
+float Quadtree::radius() const {
+  return radius_;
+}
+
+void Quadtree::set_radius(float radius) {
+  radius_ = radius;
+}
+
+unsigned int Quadtree::bucket_size() const {
+  return bucket_size_;
+}
+
+void Quadtree::set_bucket_size(unsigned int bucket_size) {
+  bucket_size_ = std::max(1u, bucket_size);
+}
+
+const std::vector<float>& Quadtree::sorted_x() const {
+  return x_;
+}
+
+const std::vector<float>& Quadtree::sorted_y() const {
+  return y_;
+}
+
+const std::vector<unsigned int>& Quadtree::sorted_indices() const {
+  return indices_;
+}
+
+std::size_t Quadtree::ghost_count() const {
+  return ghost_index_.size();
+}
+
+std::size_t Quadtree::node_count() const {
+  return nodes_.size();
+}
+
+void Quadtree::build(const std::vector<float>& x, const std::vector<float>& y, const sf::Vector2f& world_size,
+                     ThreadPool* thread_pool) {
+  /** Keys cover the world and the ghost band around it */
+  origin_ = sf::Vector2f(-radius_, -radius_);
+  extent_ = world_size + sf::Vector2f(2 * radius_, 2 * radius_);
+  entry_depth_ = 0;
+  while (entry_depth_ < kMaxEntryDepth && std::min(extent_.x, extent_.y) / (2 << entry_depth_) >= radius_) {
+    ++entry_depth_;
+  }
+
+  add_ghosts(x, y, world_size);
+  sort_along_curve(x, y, thread_pool);
+
+  nodes_.clear();
+  entries_.assign(std::size_t(1) << (2 * entry_depth_), kNoNode);
+  if (keys_.empty()) {
+    return;
+  }
+  nodes_.emplace_back();
+  build_node(0, 0, keys_.size(), kMaxDepth, 0, 0);
+}
+
+void Quadtree::add_ghosts(const std::vector<float>& x, const std::vector<float>& y, const sf::Vector2f& world_size) {
+  ghost_index_.clear();
+  ghost_x_.clear();
+  ghost_y_.clear();
+  if (!periodic_) {
+    return;
+  }
+
+  const auto kAddGhost = [this](std::size_t index, float ghost_x, float ghost_y) {
+    ghost_index_.push_back(index);
+    ghost_x_.push_back(ghost_x);
+    ghost_y_.push_back(ghost_y);
+  };
+
+  /** In a world narrower than two radii the ghosts on both sides would hold the same boids twice, like in the grid */
+  const bool kWrapX = world_size.x >= 2 * radius_;
+  const bool kWrapY = world_size.y >= 2 * radius_;
+  for (std::size_t i = 0; i < x.size(); ++i) {
+    float ghost_x = x[i];
+    if (kWrapX && x[i] < radius_) {
+      ghost_x += world_size.x;
+    } else if (kWrapX && x[i] > world_size.x - radius_) {
+      ghost_x -= world_size.x;
+    }
+
+    float ghost_y = y[i];
+    if (kWrapY && y[i] < radius_) {
+      ghost_y += world_size.y;
+    } else if (kWrapY && y[i] > world_size.y - radius_) {
+      ghost_y -= world_size.y;
+    }
+
+    if (ghost_x != x[i]) {
+      kAddGhost(i, ghost_x, y[i]);
+    }
+
+    if (ghost_y != y[i]) {
+      kAddGhost(i, x[i], ghost_y);
+    }
+
+    /** Boids near a corner are seen from the diagonally opposite corner too */
+    if (ghost_x != x[i] && ghost_y != y[i]) {
+      kAddGhost(i, ghost_x, ghost_y);
+    }
+  }
+}
+
+void Quadtree::sort_along_curve(const std::vector<float>& x, const std::vector<float>& y, ThreadPool* thread_pool) {
+  const std::size_t kCount = x.size() + ghost_index_.size();
+  keys_.resize(kCount);
+  parallel_for(thread_pool, kCount, [&](std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i) {
+      const sf::Vector2f kPoint = i < x.size() ? sf::Vector2f(x[i], y[i])
+                                               : sf::Vector2f(ghost_x_[i - x.size()], ghost_y_[i - x.size()]);
+      keys_[i] = (std::uint64_t(morton_key(kPoint - origin_, extent_)) << 32) | i;
+    }
+  });
+
+  sort_morton_keys(keys_, key_scratch_);
+
+  indices_.resize(kCount);
+  x_.resize(kCount);
+  y_.resize(kCount);
+  parallel_for(thread_pool, kCount, [&](std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i) {
+      const std::uint32_t kPoint = static_cast<std::uint32_t>(keys_[i]);
+      if (kPoint < x.size()) {
+        indices_[i] = kPoint;
+        x_[i] = x[kPoint];
+        y_[i] = y[kPoint];
+      } else {
+        const std::uint32_t kGhost = kPoint - x.size();
+        indices_[i] = ghost_index_[kGhost];
+        x_[i] = ghost_x_[kGhost];
+        y_[i] = ghost_y_[kGhost];
+      }
+    }
+  });
+}
+
+void Quadtree::build_node(std::uint32_t node, std::uint32_t begin, std::uint32_t end, int level, std::uint32_t column,
+                          std::uint32_t row) {
+  nodes_[node].begin = begin;
+  nodes_[node].end = end;
+  nodes_[node].first_child = 0;
+  nodes_[node].child_count = 0;
+
+  const int kDepth = kMaxDepth - level;
+  const bool kLeaf = end - begin <= bucket_size_ || level == 0;
+  if (kDepth == entry_depth_ || (kLeaf && kDepth < entry_depth_)) {
+    fill_entries(node, kDepth, column, row);
+  }
+
+  if (kLeaf) {
+    Node& leaf = nodes_[node];
+    leaf.min_x = leaf.max_x = x_[begin];
+    leaf.min_y = leaf.max_y = y_[begin];
+    for (std::uint32_t i = begin + 1; i < end; ++i) {
+      leaf.min_x = std::min(leaf.min_x, x_[i]);
+      leaf.max_x = std::max(leaf.max_x, x_[i]);
+      leaf.min_y = std::min(leaf.min_y, y_[i]);
+      leaf.max_y = std::max(leaf.max_y, y_[i]);
+    }
+    return;
+  }
+
+  /** Keys of the node share all bits above the two quadrant bits of this level, so quadrants are sorted */
+  const int kShift = 32 + 2 * (level - 1);
+  std::uint32_t child_begin[5];
+  child_begin[0] = begin;
+  child_begin[4] = end;
+  for (std::uint64_t quadrant = 1; quadrant < 4; ++quadrant) {
+    child_begin[quadrant] = std::partition_point(keys_.begin() + child_begin[quadrant - 1], keys_.begin() + end,
+                                                 [kShift, quadrant](std::uint64_t key) {
+                                                   return ((key >> kShift) & 3) < quadrant;
+                                                 }) - keys_.begin();
+  }
+
+  std::uint32_t child_count = 0;
+  for (int quadrant = 0; quadrant < 4; ++quadrant) {
+    child_count += child_begin[quadrant] != child_begin[quadrant + 1];
+  }
+
+  /** Allocate children before building them, so they stay next to each other */
+  const std::uint32_t kFirstChild = nodes_.size();
+  nodes_.resize(nodes_.size() + child_count);
+  std::uint32_t child = kFirstChild;
+  for (int quadrant = 0; quadrant < 4; ++quadrant) {
+    if (child_begin[quadrant] != child_begin[quadrant + 1]) {
+      /** x is in the even and y in the odd key bits */
+      build_node(child++, child_begin[quadrant], child_begin[quadrant + 1], level - 1, column * 2 + (quadrant & 1),
+                 row * 2 + (quadrant >> 1));
+    }
+  }
+
+  /** nodes_ may have moved while building the children */
+  Node& parent = nodes_[node];
+  parent.first_child = kFirstChild;
+  parent.child_count = child_count;
+  parent.min_x = nodes_[kFirstChild].min_x;
+  parent.max_x = nodes_[kFirstChild].max_x;
+  parent.min_y = nodes_[kFirstChild].min_y;
+  parent.max_y = nodes_[kFirstChild].max_y;
+  for (std::uint32_t i = kFirstChild + 1; i < kFirstChild + child_count; ++i) {
+    parent.min_x = std::min(parent.min_x, nodes_[i].min_x);
+    parent.max_x = std::max(parent.max_x, nodes_[i].max_x);
+    parent.min_y = std::min(parent.min_y, nodes_[i].min_y);
+    parent.max_y = std::max(parent.max_y, nodes_[i].max_y);
+  }
+}
+
+void Quadtree::fill_entries(std::uint32_t node, int depth, std::uint32_t column, std::uint32_t row) {
+  const int kShift = entry_depth_ - depth;
+  const std::uint32_t kCells = 1u << kShift;
+  for (std::uint32_t r = row << kShift; r < (row << kShift) + kCells; ++r) {
+    std::fill_n(entries_.begin() + (r << entry_depth_) + (column << kShift), kCells, node);
+  }
+}
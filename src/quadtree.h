@@ -0,0 +1,321 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <SFML/System/Vector2.hpp>
+
+class ThreadPool;
+
+/**
+ * Adaptive quadtree spatial index.
+ *
+ * A uniform grid degenerates when flocks collapse into clumps: hundreds of
+ * boids share a cell while most cells stay empty, and every query scans the
+ * whole 3x3 block around it. The quadtree splits only where boids are, until
+ * a node holds at most bucket_size() boids, so queries in a clump scan little
+ * more than the boids within the query radius.
+ *
+ * It is rebuilt from scratch every frame like the grid: boids are sorted
+ * along a Z-order curve, which lays out every node as a contiguous range, and
+ * the nodes are cut out of the sorted keys. Periodic boundaries work like in
+ * the grid, boids within the query radius of an edge get a ghost copy on the
+ * opposite side, shifted by the world size.
+ */
+class Quadtree {
+ public:
+  /**
+   * Create quadtree.
+   *
+   * \param radius Query radius, the largest radius that will be queried.
+   * \param bucket_size Most boids in a leaf, leaves at the deepest level can hold more.
+   */
+  explicit Quadtree(float radius, unsigned int bucket_size = 64);
+
+  bool periodic() const;
+
+  /**
+   * Enable periodic boundaries, takes effect on the next build().
+   *
+   * \param periodic True if queries should wrap around the world edges.
+   */
+  void set_periodic(bool periodic);
+
+  float radius() const;
+
+  /**
+   * Set query radius, takes effect on the next build().
+   *
+   * \param radius Query radius.
+   */
+  void set_radius(float radius);
+
+  unsigned int bucket_size() const;
+
+  /**
+   * Set leaf size, takes effect on the next build().
+   *
+   * Smaller buckets prune more candidates but take more nodes to visit.
+   *
+   * \param bucket_size Most boids in a leaf, at least 1.
+   */
+  void set_bucket_size(unsigned int bucket_size);
+
+  /**
+   * Rebuild quadtree.
+   *
+   * \param x X coordinates of all boids.
+   * \param y Y coordinates of all boids.
+   * \param world_size World size.
+   * \param thread_pool Thread pool to compute keys and gather boids on, null for the calling thread.
+   */
+  void build(const std::vector<float>& x, const std::vector<float>& y, const sf::Vector2f& world_size,
+             ThreadPool* thread_pool = nullptr);
+
+  /**
+   * Call f with every range of sorted boids in the leaves within radius() of position.
+   *
+   * Same interface as Grid::for_each_candidate_range(). Leaves next to each
+   * other in curve order are merged into one range.
+   *
+   * \param position Query position.
+   * \param f Callable taking begin and end of a range.
+   */
+  template<class F>
+  void for_each_candidate_range(const sf::Vector2f& position, F&& f) const {
+    if (nodes_.empty()) {
+      return;
+    }
+
+    /** Entry cells are at least radius() wide, so the 3x3 block around the position holds every neighbor */
+    const int kColumn = entry_cell(position.x - origin_.x, extent_.x);
+    const int kRow = entry_cell(position.y - origin_.y, extent_.y);
+    const int kLast = (1 << entry_depth_) - 1;
+    const float kRadiusSquared = radius_ * radius_;
+    /** Leaves above the entry depth cover several cells, every node is searched once */
+    std::uint32_t searched[9];
+    int searched_count = 0;
+    unsigned int range_begin = 0;
+    unsigned int range_end = 0;
+    for (int row = std::max(kRow - 1, 0); row <= std::min(kRow + 1, kLast); ++row) {
+      for (int column = std::max(kColumn - 1, 0); column <= std::min(kColumn + 1, kLast); ++column) {
+        const std::uint32_t kEntry = entries_[(row << entry_depth_) + column];
+        if (kEntry == kNoNode || std::find(searched, searched + searched_count, kEntry) != searched + searched_count) {
+          continue;
+        }
+        searched[searched_count++] = kEntry;
+        if (distance_squared(nodes_[kEntry], position) > kRadiusSquared) {
+          continue;
+        }
+
+        /** Nodes are only pushed within the radius, three siblings wait on every level at most */
+        std::uint32_t stack[kMaxDepth * 3 + 1];
+        int stack_size = 0;
+        stack[stack_size++] = kEntry;
+        while (stack_size > 0) {
+          const Node& kNode = nodes_[stack[--stack_size]];
+          if (kNode.child_count == 0) {
+            if (kNode.begin != range_end) {
+              if (range_begin != range_end) {
+                f(range_begin, range_end);
+              }
+              range_begin = kNode.begin;
+            }
+            range_end = kNode.end;
+            continue;
+          }
+
+          /** Reverse order, so children are visited in curve order */
+          for (std::uint32_t child = kNode.first_child + kNode.child_count; child-- > kNode.first_child;) {
+            stack[stack_size] = child;
+            stack_size += distance_squared(nodes_[child], position) <= kRadiusSquared;
+          }
+        }
+      }
+    }
+
+    if (range_begin != range_end) {
+      f(range_begin, range_end);
+    }
+  }
+
+  /**
+   * Call f with every range of sorted boids in the leaves within a shrinking radius of position.
+   *
+   * For nearest neighbor searches: f returns the squared radius to search on
+   * within, usually the distance of the farthest of the nearest boids found so
+   * far, and leaves beyond it are skipped. The position's own entry cell and
+   * the nearest child of every node are searched first, so the radius shrinks
+   * early and the search stays about as short in a dense clump as in a sparse
+   * flock. Ranges are not merged.
+   *
+   * \param position Query position.
+   * \param f Callable taking begin and end of a range, returning a squared radius not above radius() squared.
+   */
+  template<class F>
+  void for_each_nearest_candidate_range(const sf::Vector2f& position, F&& f) const {
+    if (nodes_.empty()) {
+      return;
+    }
+
+    const int kColumn = entry_cell(position.x - origin_.x, extent_.x);
+    const int kRow = entry_cell(position.y - origin_.y, extent_.y);
+    const int kLast = (1 << entry_depth_) - 1;
+    float radius_squared = radius_ * radius_;
+    std::uint32_t searched[9];
+    int searched_count = 0;
+    /** Own cell first, then the 3x3 block around it */
+    for (int cell = -1; cell < 9; ++cell) {
+      const int kRowOffset = cell < 0 ? 0 : cell / 3 - 1;
+      const int kColumnOffset = cell < 0 ? 0 : cell % 3 - 1;
+      const int kEntryRow = kRow + kRowOffset;
+      const int kEntryColumn = kColumn + kColumnOffset;
+      if (kEntryRow < 0 || kEntryRow > kLast || kEntryColumn < 0 || kEntryColumn > kLast) {
+        continue;
+      }
+
+      const std::uint32_t kEntry = entries_[(kEntryRow << entry_depth_) + kEntryColumn];
+      if (kEntry == kNoNode || std::find(searched, searched + searched_count, kEntry) != searched + searched_count) {
+        continue;
+      }
+      searched[searched_count++] = kEntry;
+
+      std::uint32_t stack[kMaxDepth * 3 + 1];
+      int stack_size = 0;
+      stack[stack_size++] = kEntry;
+      while (stack_size > 0) {
+        const Node& kNode = nodes_[stack[--stack_size]];
+        /** Nodes were pushed within an older, larger radius */
+        if (distance_squared(kNode, position) > radius_squared) {
+          continue;
+        }
+
+        if (kNode.child_count == 0) {
+          radius_squared = f(kNode.begin, kNode.end);
+          continue;
+        }
+
+        /** Farthest children are pushed first, so the nearest one is searched first */
+        std::uint32_t children[4];
+        float distances[4];
+        std::uint32_t child_count = 0;
+        for (std::uint32_t child = kNode.first_child; child < kNode.first_child + kNode.child_count; ++child) {
+          const float kDistance = distance_squared(nodes_[child], position);
+          std::uint32_t i = child_count++;
+          for (; i > 0 && distances[i - 1] < kDistance; --i) {
+            children[i] = children[i - 1];
+            distances[i] = distances[i - 1];
+          }
+          children[i] = child;
+          distances[i] = kDistance;
+        }
+
+        for (std::uint32_t i = 0; i < child_count; ++i) {
+          stack[stack_size] = children[i];
+          stack_size += distances[i] <= radius_squared;
+        }
+      }
+    }
+  }
+
+  /** Boid x coordinates in curve order, ghost copies included */
+  const std::vector<float>& sorted_x() const;
+  /** Boid y coordinates in curve order, ghost copies included */
+  const std::vector<float>& sorted_y() const;
+  /** Boid indices in curve order, ghost copies have the index of their boid */
+  const std::vector<unsigned int>& sorted_indices() const;
+
+  /** Number of ghost copies made by the last build() */
+  std::size_t ghost_count() const;
+  /** Number of nodes built by the last build(), leaves included */
+  std::size_t node_count() const;
+
+ private:
+  /** Levels below the root, one per two bits of the Morton keys */
+  static constexpr int kMaxDepth = 16;
+  /** Deepest level of entry cells, caps the entry table at 4^kMaxEntryDepth cells */
+  static constexpr int kMaxEntryDepth = 10;
+  static constexpr std::uint32_t kNoNode = 0xffffffff;
+
+  struct Node {
+    /** Bounds of the boids in the node, tighter than the quadrant */
+    float min_x;
+    float min_y;
+    float max_x;
+    float max_y;
+    /** Range of the node's boids in the sorted arrays */
+    std::uint32_t begin;
+    std::uint32_t end;
+    /** Non-empty children are stored next to each other, none for a leaf */
+    std::uint32_t first_child;
+    std::uint32_t child_count;
+  };
+
+  static float distance_squared(const Node& node, const sf::Vector2f& position) {
+    const float kDx = std::max(std::max(node.min_x - position.x, position.x - node.max_x), 0.0f);
+    const float kDy = std::max(std::max(node.min_y - position.y, position.y - node.max_y), 0.0f);
+    return kDx * kDx + kDy * kDy;
+  }
+
+  /**
+   * Get entry cell of a coordinate, quantized like the Morton keys.
+   *
+   * \param offset Coordinate relative to the origin.
+   * \param extent Extent on the axis.
+   */
+  int entry_cell(float offset, float extent) const {
+    const float kScaled = offset / extent * 65536;
+    return static_cast<int>(std::min(std::max(kScaled, 0.0f), 65535.0f)) >> (kMaxDepth - entry_depth_);
+  }
+
+  void add_ghosts(const std::vector<float>& x, const std::vector<float>& y, const sf::Vector2f& world_size);
+  void sort_along_curve(const std::vector<float>& x, const std::vector<float>& y, ThreadPool* thread_pool);
+
+  /**
+   * Build node of sorted boids whose keys share all bits above level.
+   *
+   * \param node Index of the node in nodes_, already allocated.
+   * \param begin First sorted boid.
+   * \param end Sorted boid after the last one.
+   * \param level Levels left below the node.
+   * \param column Column of the node's quadrant on its level.
+   * \param row Row of the node's quadrant on its level.
+   */
+  void build_node(std::uint32_t node, std::uint32_t begin, std::uint32_t end, int level, std::uint32_t column,
+                  std::uint32_t row);
+
+  /**
+   * Point the entry cells of a quadrant at a node.
+   *
+   * \param node Node index.
+   * \param depth Level of the quadrant below the root, at most entry_depth_.
+   * \param column Column of the quadrant on its level.
+   * \param row Row of the quadrant on its level.
+   */
+  void fill_entries(std::uint32_t node, int depth, std::uint32_t column, std::uint32_t row);
+
+  float radius_;
+  unsigned int bucket_size_;
+  bool periodic_ = false;
+  /** Ghost copies: boid index and shifted coordinates */
+  std::vector<unsigned int> ghost_index_;
+  std::vector<float> ghost_x_;
+  std::vector<float> ghost_y_;
+  /** Morton key in the upper and unsorted boid or ghost in the lower half, sorted */
+  std::vector<std::uint64_t> keys_;
+  std::vector<std::uint64_t> key_scratch_;
+  std::vector<unsigned int> indices_;
+  std::vector<float> x_;
+  std::vector<float> y_;
+  std::vector<Node> nodes_;
+  /** Area covered by the keys, the world and the ghost band around it */
+  sf::Vector2f origin_;
+  sf::Vector2f extent_ = sf::Vector2f(1, 1);
+  /**
+   * Quadrants on the entry depth form a grid of cells at least radius_ wide,
+   * each pointing at the deepest node covering it, so queries skip the levels
+   * above. Row-major, 2^entry_depth_ cells per row.
+   */
+  int entry_depth_ = 0;
+  std::vector<std::uint32_t> entries_;
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Counter-based random numbers.
+ *
+ * Every number is a hash of a seed and a counter, there is no generator state
+ * to share between threads. The same seed and counter always give the same
+ * number, no matter which thread asks or in which order. The hash is the
+ * SplitMix64 output function.
+ */
+
+/** SplitMix64 finalizer, a bijective mix of all 64 bits */
+inline std::uint64_t mix_bits(std::uint64_t bits) {
+  bits = (bits ^ (bits >> 30)) * 0xbf58476d1ce4e5b9ull;
+  bits = (bits ^ (bits >> 27)) * 0x94d049bb133111ebull;
+  return bits ^ (bits >> 31);
+}
+
+/**
+ * Get random bits.
+ *
+ * \param seed Seed of the stream.
+ * \param counter Position in the stream.
+ * \return 64 random bits.
+ */
+inline std::uint64_t random_bits(std::uint64_t seed, std::uint64_t counter) {
+  /** Mixing the seed first keeps streams of nearby seeds apart */
+  return mix_bits(mix_bits(seed) + (counter + 1) * 0x9e3779b97f4a7c15ull);
+}
+
+/**
+ * Map random bits to an integer range.
+ *
+ * \param bits Random bits.
+ * \param min Smallest value.
+ * \param max Largest value, at most 2^32 - 1 above min.
+ * \return Value in [min, max].
+ */
+inline int random_int(std::uint64_t bits, int min, int max) {
+  const std::uint64_t kRange = static_cast<std::uint64_t>(static_cast<std::int64_t>(max) - min) + 1;
+  /** Multiply-shift instead of modulo, same bias, no division */
+  return static_cast<int>(min + static_cast<std::int64_t>(((bits >> 32) * kRange) >> 32));
+}
+
+/**
+ * Map random bits to a float range.
+ *
+ * \param bits Random bits.
+ * \param min Smallest value.
+ * \param max End of the range.
+ * \return Value in [min, max).
+ */
+inline float random_float(std::uint64_t bits, float min, float max) {
+  /** 24 bits fill the float mantissa */
+  const float kUnit = static_cast<float>(bits >> 40) * (1.0f / (1 << 24));
+  return min + (max - min) * kUnit;
+}
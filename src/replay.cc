@@ -0,0 +1,158 @@
+#include "replay.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+#include "draw.h"
+#include "trajectory_player.h"
+
+namespace {
+
+constexpr float kMinSpeed = 1.0f / 16;
+constexpr float kMaxSpeed = 256;
+/** Seconds the arrow keys jump */
+constexpr float kJumpSeconds = 1;
+constexpr float kProgressBarHeight = 12;
+
+/** Frame under a window x coordinate on the progress bar */
+double frame_at(float x, const sf::RenderWindow& window, const TrajectoryPlayer& player) {
+  return static_cast<double>(x) / window.getSize().x * player.end_frame();
+}
+
+}
+
+int run_replay(const std::string& path, sf::RenderWindow& window, const sf::Font& font) {
+  std::unique_ptr<TrajectoryPlayer> player;
+  try {
+    player.reset(new TrajectoryPlayer(path));
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  player->set_paused(false);
+  window.setMouseCursorVisible(true);
+
+  sf::VertexArray boid_vertices(sf::Triangles);
+  sf::Text help_text(
+      std::string("Replay:\n") +
+        "space : pause\n" +
+        "left/right : jump back/forward\n" +
+        ", / . : previous/next frame\n" +
+        "up/down : faster/slower\n" +
+        "home : restart\n" +
+        "Click or drag on the bar to seek\n",
+      font);
+  sf::Text status_text;
+  status_text.setFont(font);
+  status_text.setCharacterSize(16);
+
+  sf::Clock clock;
+  bool scrubbing = false;
+  while (window.isOpen()) {
+    sf::Event event;
+    while (window.pollEvent(event)) {
+      if (event.type == sf::Event::Closed) {
+        window.close();
+      }
+
+      if (event.type == sf::Event::MouseButtonPressed && event.mouseButton.button == sf::Mouse::Left &&
+          event.mouseButton.y >= window.getSize().y - 2 * kProgressBarHeight) {
+        scrubbing = true;
+        player->seek(frame_at(event.mouseButton.x, window, *player));
+      }
+      if (event.type == sf::Event::MouseMoved && scrubbing) {
+        player->seek(frame_at(event.mouseMove.x, window, *player));
+      }
+      if (event.type == sf::Event::MouseButtonReleased) {
+        scrubbing = false;
+      }
+
+      if (event.type == sf::Event::KeyPressed) {
+        const double kJumpFrames = kJumpSeconds / player->dt();
+        switch(event.key.code) {
+          case sf::Keyboard::Space: {
+            /** Play again from the start at the end */
+            if (player->paused() && player->position() >= player->end_frame() - 1) {
+              player->seek(0);
+            }
+            player->set_paused(!player->paused());
+            break;
+          }
+          case sf::Keyboard::Left: {
+            player->seek(player->position() - kJumpFrames);
+            break;
+          }
+          case sf::Keyboard::Right: {
+            player->seek(player->position() + kJumpFrames);
+            break;
+          }
+          case sf::Keyboard::Comma: {
+            player->set_paused(true);
+            player->seek(std::ceil(player->position()) - 1);
+            break;
+          }
+          case sf::Keyboard::Period: {
+            player->set_paused(true);
+            player->seek(std::floor(player->position()) + 1);
+            break;
+          }
+          case sf::Keyboard::Up: {
+            player->set_speed(std::min(kMaxSpeed, player->speed() * 2));
+            break;
+          }
+          case sf::Keyboard::Down: {
+            player->set_speed(std::max(kMinSpeed, player->speed() / 2));
+            break;
+          }
+          case sf::Keyboard::Home: {
+            player->seek(0);
+            break;
+          }
+          default: {
+            break;
+          }
+        };
+      }
+    }
+
+    /** Scrubbing holds the position under the mouse */
+    if (!scrubbing) {
+      player->advance(clock.getElapsedTime().asSeconds());
+    }
+    clock.restart();
+
+    window.clear(sf::Color::Black);
+
+    /** The recorded world fills the window */
+    const sf::Vector2f kWorldSize = player->frame().world_size;
+    window.setView(sf::View(sf::FloatRect(0, 0, kWorldSize.x, kWorldSize.y)));
+    draw_trajectory(*player, window, boid_vertices);
+
+    const sf::Vector2f kWindowSize(window.getSize());
+    window.setView(sf::View(sf::FloatRect(0, 0, kWindowSize.x, kWindowSize.y)));
+    window.draw(help_text);
+
+    std::ostringstream status;
+    status << "frame " << player->frame().index << " / " << player->end_frame() << ", "
+           << player->frame().x.size() << " boids, speed " << player->speed() << "x"
+           << (player->paused() ? ", paused" : "") << ", " << player->decoded_frame_count() << " frames decoded";
+    status_text.setString(status.str());
+    status_text.setPosition(0, kWindowSize.y - 2 * kProgressBarHeight - 24);
+    window.draw(status_text);
+
+    sf::RectangleShape progress_bar(sf::Vector2f(kWindowSize.x, kProgressBarHeight));
+    progress_bar.setPosition(0, kWindowSize.y - 1.5f * kProgressBarHeight);
+    progress_bar.setFillColor(sf::Color(64, 64, 64));
+    window.draw(progress_bar);
+    progress_bar.setSize(sf::Vector2f(kWindowSize.x * player->position() / player->end_frame(), kProgressBarHeight));
+    progress_bar.setFillColor(sf::Color(160, 160, 160));
+    window.draw(progress_bar);
+
+    window.display();
+  }
+
+  return 0;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+#include <SFML/Graphics.hpp>
+
+/**
+ * Play back a recorded trajectory in the window until it is closed.
+ *
+ * Nothing is simulated, frames are decoded from the memory mapped file and
+ * drawn. Playback can be paused, scrubbed and sped up.
+ *
+ * \param path Trajectory file path.
+ * \param window Window.
+ * \param font HUD font.
+ * \return Exit code, nonzero if the trajectory cannot be read.
+ */
+int run_replay(const std::string& path, sf::RenderWindow& window, const sf::Font& font);
@@ -0,0 +1,343 @@
+#include "simulation.h"
+
+#include <algorithm>
+#include <random>
+#include "random.h"
+#include "snapshot.h"
+#include "utils.h"
+
+namespace {
+
+/** Verlet list skin, boids at default speed can move for about ten 60 Hz updates before a rebuild */
+constexpr float kDefaultVerletSkin = 60;
+
+}
+
+Simulation::Simulation(const sf::Vector2f& world_size, unsigned int thread_count)
+  : world_size_(world_size),
+    grid_(Boid::cohesion_distance()),
+    thread_pool_(thread_count),
+    neighbor_list_(kDefaultVerletSkin),
+    quadtree_(Boid::cohesion_distance()),
+    aggregate_grid_(Boid::cohesion_distance()) {
+  grid_.set_periodic(true);
+  quadtree_.set_periodic(true);
+  aggregate_grid_.set_periodic(true);
+  std::random_device rd;
+  set_seed(static_cast<std::uint64_t>(rd()) << 32 | rd());
+}
+
+const Boids& Simulation::boids() const {
+  return boids_;
+}
+
+const sf::Vector2f& Simulation::world_size() const {
+  return world_size_;
+}
+
+void Simulation::set_world_size(const sf::Vector2f& world_size) {
+  world_size_ = world_size;
+  invalidate_neighbors();
+}
+
+unsigned int Simulation::thread_count() const {
+  return thread_pool_.thread_count();
+}
+
+ThreadPool& Simulation::thread_pool() {
+  return thread_pool_;
+}
+
+HeadingMode Simulation::heading_mode() const {
+  return boids_.heading_mode();
+}
+
+void Simulation::set_heading_mode(HeadingMode heading_mode) {
+  boids_.set_heading_mode(heading_mode);
+}
+
+bool Simulation::periodic_boundaries() const {
+  return grid_.periodic();
+}
+
+void Simulation::set_periodic_boundaries(bool periodic_boundaries) {
+  grid_.set_periodic(periodic_boundaries);
+  quadtree_.set_periodic(periodic_boundaries);
+  aggregate_grid_.set_periodic(periodic_boundaries);
+  invalidate_neighbors();
+}
+
+NeighborSearch Simulation::neighbor_search() const {
+  return neighbor_search_;
+}
+
+void Simulation::set_neighbor_search(NeighborSearch neighbor_search) {
+  neighbor_search_ = neighbor_search;
+  grid_.set_cell_size(grid_cell_size());
+  invalidate_neighbors();
+}
+
+float Simulation::verlet_skin() const {
+  return neighbor_list_.skin();
+}
+
+void Simulation::set_verlet_skin(float skin) {
+  neighbor_list_.set_skin(skin);
+  grid_.set_cell_size(grid_cell_size());
+}
+
+unsigned int Simulation::quadtree_bucket_size() const {
+  return quadtree_.bucket_size();
+}
+
+void Simulation::set_quadtree_bucket_size(unsigned int bucket_size) {
+  quadtree_.set_bucket_size(bucket_size);
+}
+
+int Simulation::aggregate_grid_subdivisions() const {
+  return aggregate_grid_.subdivisions();
+}
+
+void Simulation::set_aggregate_grid_subdivisions(int subdivisions) {
+  aggregate_grid_.set_subdivisions(subdivisions);
+}
+
+std::size_t Simulation::verlet_build_count() const {
+  return neighbor_list_.build_count();
+}
+
+void Simulation::sort_spatially() {
+  boids_.sort_spatially(world_size_);
+  updates_since_spatial_sort_ = 0;
+  invalidate_neighbors();
+}
+
+unsigned int Simulation::spatial_sort_interval() const {
+  return spatial_sort_interval_;
+}
+
+void Simulation::set_spatial_sort_interval(unsigned int interval) {
+  /** Setting the same interval again keeps the count, like the one of a loaded snapshot */
+  if (interval != spatial_sort_interval_) {
+    spatial_sort_interval_ = interval;
+    updates_since_spatial_sort_ = 0;
+  }
+}
+
+unsigned int Simulation::topological_neighbor_count() const {
+  return boids_.topological_neighbor_count();
+}
+
+void Simulation::set_topological_neighbor_count(unsigned int count) {
+  boids_.set_topological_neighbor_count(count);
+}
+
+std::uint64_t Simulation::seed() const {
+  return boids_.seed();
+}
+
+void Simulation::set_seed(std::uint64_t seed) {
+  boids_.set_seed(seed);
+  randomized_count_ = 0;
+}
+
+void Simulation::set_profiler(Profiler* profiler) {
+  profiler_ = profiler;
+}
+
+void Simulation::save_snapshot(const std::string& path, const Predators& predators) const {
+  SnapshotWriter writer(path);
+  writer(world_size_);
+  writer(static_cast<std::uint8_t>(grid_.periodic()));
+  writer(randomized_count_);
+  writer(updates_since_spatial_sort_);
+  boids_.save(writer);
+  writer(predators);
+  writer.close();
+}
+
+void Simulation::load_snapshot(const std::string& path, Predators& predators) {
+  SnapshotReader reader(path);
+  sf::Vector2f world_size;
+  std::uint8_t periodic = 0;
+  std::uint64_t randomized_count = 0;
+  unsigned int updates_since_spatial_sort = 0;
+  Boids boids;
+  Predators loaded_predators;
+  reader(world_size);
+  reader(periodic);
+  reader(randomized_count);
+  reader(updates_since_spatial_sort);
+  boids.load(reader);
+  reader(loaded_predators);
+
+  /** Everything is read, nothing below throws */
+  boids.set_topological_neighbor_count(boids_.topological_neighbor_count());
+  boids_ = std::move(boids);
+  predators.swap(loaded_predators);
+  world_size_ = world_size;
+  grid_.set_periodic(periodic != 0);
+  quadtree_.set_periodic(periodic != 0);
+  aggregate_grid_.set_periodic(periodic != 0);
+  randomized_count_ = randomized_count;
+  updates_since_spatial_sort_ = updates_since_spatial_sort;
+  invalidate_neighbors();
+}
+
+void Simulation::randomize_boids() {
+  for (Boids::size_type i = 0; i < boids_.size(); ++i) {
+    randomize_boid(i);
+  }
+  invalidate_neighbors();
+}
+
+void Simulation::add_boids(unsigned int count) {
+  /** No exact reserve, adding a few boids at a time would reallocate every time */
+  for (unsigned int i = 0; i < count; ++i) {
+    boids_.push_back(sf::Vector2f(), 0, sf::Color::White);
+    randomize_boid(boids_.size() - 1);
+  }
+  invalidate_neighbors();
+}
+
+void Simulation::remove_boids(unsigned int count) {
+  if (boids_.size() > 1) {
+    boids_.pop_back(std::min<Boids::size_type>(count, boids_.size() - 1));
+  }
+  invalidate_neighbors();
+}
+
+bool Simulation::remove_boid(const BoidHandle& handle) {
+  invalidate_neighbors();
+  return boids_.erase(handle);
+}
+
+void Simulation::add_predators(Predators& predators, unsigned int count) {
+  for (unsigned int i = 0; i < count; ++i) {
+    /** Predators draw from the same streams as randomized boids, so seeded runs replay them too */
+    const std::uint64_t kKey = random_bits(boids_.seed(), randomized_count_++);
+    Predator predator;
+    predator.position = sf::Vector2f(random_float(random_bits(kKey, 0), 0, world_size_.x),
+                                     random_float(random_bits(kKey, 1), 0, world_size_.y));
+    const float kAngle = random_float(random_bits(kKey, 2), 0, 2 * kPi<float>);
+    predator.velocity = sf::Vector2f(std::cos(kAngle), std::sin(kAngle)) * Predator::kConfig_.kChaseSpeed;
+    predator.autonomous = true;
+    predators.push_back(predator);
+  }
+}
+
+void Simulation::update(Predators& predators, float dt) {
+  update(predators.data(), predators.size(), dt);
+}
+
+void Simulation::update(Predator* predators, std::size_t predator_count, float dt) {
+  {
+    BOIDS_PROFILE_SCOPE(profiler_, ProfilePhase::kPredatorUpdate);
+    update_predators(predators, predator_count, dt);
+  }
+
+  if (spatial_sort_interval_ > 0 && ++updates_since_spatial_sort_ >= spatial_sort_interval_) {
+    BOIDS_PROFILE_SCOPE(profiler_, ProfilePhase::kSpatialSort);
+    sort_spatially();
+  }
+
+  {
+    BOIDS_PROFILE_SCOPE(profiler_, ProfilePhase::kNeighborIndex);
+    if (neighbor_search_ == NeighborSearch::kVerletList) {
+      /** Most updates skip the grid entirely */
+      if (neighbor_list_.needs_rebuild(boids_.x(), boids_.y())) {
+        grid_.build(boids_.x(), boids_.y(), world_size_, &thread_pool_);
+        neighbor_list_.build(grid_, boids_.x(), boids_.y(), Boid::cohesion_distance(), world_size_, thread_pool_);
+      }
+    } else if (neighbor_search_ == NeighborSearch::kQuadtree) {
+      quadtree_.build(boids_.x(), boids_.y(), world_size_, &thread_pool_);
+    } else if (neighbor_search_ == NeighborSearch::kCellAggregates) {
+      boids_.headings(heading_sin_, heading_cos_);
+      aggregate_grid_.build(boids_.x(), boids_.y(), heading_sin_, heading_cos_, world_size_);
+    } else {
+      grid_.build(boids_.x(), boids_.y(), world_size_, &thread_pool_);
+    }
+  }
+
+  BOIDS_PROFILE_SCOPE(profiler_, ProfilePhase::kBoidUpdate);
+  boids_.begin_update();
+  thread_pool_.parallel_for(boids_.size(), [&](std::size_t begin, std::size_t end) {
+    const auto kUpdateRange = [&](const auto& neighbors) {
+#ifdef BOIDS_PROFILING
+      if (profiler_ != nullptr) {
+        /** Every sampled boid stands for the boids up to the next sample */
+        constexpr std::size_t kSampleStride = 64;
+        Boids::PhaseTimes times;
+        for (std::size_t i = begin; i < end; ++i) {
+          if (i % kSampleStride == 0) {
+            boids_.update(i, neighbors, predator_index_, dt, world_size_, &times);
+          } else {
+            boids_.update(i, neighbors, predator_index_, dt, world_size_);
+          }
+        }
+        profiler_->add(ProfilePhase::kNeighborSearch, times.neighbor_search * kSampleStride);
+        profiler_->add(ProfilePhase::kRuleEvaluation, times.rule_evaluation * kSampleStride);
+        profiler_->add(ProfilePhase::kIntegration, times.integration * kSampleStride);
+        return;
+      }
+#endif
+      for (std::size_t i = begin; i < end; ++i) {
+        boids_.update(i, neighbors, predator_index_, dt, world_size_);
+      }
+    };
+
+    if (neighbor_search_ == NeighborSearch::kVerletList) {
+      kUpdateRange(neighbor_list_);
+    } else if (neighbor_search_ == NeighborSearch::kQuadtree) {
+      kUpdateRange(quadtree_);
+    } else if (neighbor_search_ == NeighborSearch::kCellAggregates) {
+      kUpdateRange(aggregate_grid_);
+    } else {
+      kUpdateRange(grid_);
+    }
+  });
+  boids_.end_update();
+}
+
+void Simulation::randomize_boid(Boids::size_type index) {
+  /** Every randomized boid gets its own stream, one counter per value */
+  const std::uint64_t kKey = random_bits(boids_.seed(), randomized_count_++);
+  const auto kColorChannel = [kKey](std::uint64_t counter) {
+    return static_cast<sf::Uint8>(random_int(random_bits(kKey, counter), 50, 255));
+  };
+
+  boids_.assign(index,
+                sf::Vector2f(random_float(random_bits(kKey, 0), 0, world_size_.x),
+                             random_float(random_bits(kKey, 1), 0, world_size_.y)),
+                random_int(random_bits(kKey, 2), 0, 359),
+                sf::Color(kColorChannel(3), kColorChannel(4), kColorChannel(5)));
+}
+
+void Simulation::update_predators(Predator* predators, std::size_t predator_count, float dt) {
+  const bool kAnyAutonomous = std::any_of(predators, predators + predator_count, [](const Predator& predator) {
+    return predator.autonomous;
+  });
+  if (kAnyAutonomous) {
+    flock_centers_.build(boids_.x(), boids_.y(), world_size_);
+    thread_pool_.parallel_for(predator_count, [&](std::size_t begin, std::size_t end) {
+      for (std::size_t i = begin; i < end; ++i) {
+        predators[i].update(flock_centers_, dt, world_size_);
+      }
+    });
+  }
+
+  predator_index_.build(predators, predator_count, Boid::predator_detection_distance(), world_size_);
+}
+
+void Simulation::invalidate_neighbors() {
+  neighbor_list_.invalidate();
+}
+
+float Simulation::grid_cell_size() const {
+  /** Verlet lists are built with the skin on top of the cohesion distance */
+  if (neighbor_search_ == NeighborSearch::kVerletList) {
+    return Boid::cohesion_distance() + neighbor_list_.skin();
+  }
+
+  return Boid::cohesion_distance();
+}
@@ -0,0 +1,267 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <SFML/System/Vector2.hpp>
+#include "aggregate_grid.h"
+#include "boid.h"
+#include "grid.h"
+#include "neighbor_list.h"
+#include "predator.h"
+#include "profiler.h"
+#include "quadtree.h"
+#include "thread_pool.h"
+
+/** How flockmates are found */
+enum class NeighborSearch {
+  /** Search the grid every update */
+  kGrid,
+  /** Reuse Verlet lists until some boid moved more than half their skin */
+  kVerletList,
+  /** Search a quadtree every update, adapts to boids clumping together */
+  kQuadtree,
+  /** Search a fine grid every update, cells within a rule distance count as a whole, fastest for dense flocks */
+  kCellAggregates,
+};
+
+/**
+ * Boids simulation.
+ *
+ * Owns the flock and everything needed to step it, without any rendering, so
+ * it can run on machines without a display.
+ */
+class Simulation {
+ public:
+  /**
+   * Create simulation.
+   *
+   * \param world_size World size, boids wrap around at its edges.
+   * \param thread_count Number of simulation threads, zero picks the number of hardware threads.
+   */
+  explicit Simulation(const sf::Vector2f& world_size, unsigned int thread_count = 0);
+
+  const Boids& boids() const;
+  const sf::Vector2f& world_size() const;
+  void set_world_size(const sf::Vector2f& world_size);
+  unsigned int thread_count() const;
+
+  /** Thread pool of the simulation, for other per-frame work to share its threads */
+  ThreadPool& thread_pool();
+  HeadingMode heading_mode() const;
+  void set_heading_mode(HeadingMode heading_mode);
+
+  bool periodic_boundaries() const;
+
+  /**
+   * Let boids see neighbors across the world edges, like they move across them. On by default.
+   *
+   * Neighbor search only wraps on an axis where the world is at least two
+   * cohesion distances wide, 400 pixels by default, or two cohesion distances
+   * plus the skin with Verlet lists. On a narrower axis boids near opposite
+   * edges do not see each other, even with periodic boundaries on: one copy
+   * of every boid on each side would put boids into the search twice, and the
+   * neighbor search has no per pair minimum image to pick the nearer copy.
+   * Boids still move across the edges of every axis.
+   *
+   * \param periodic_boundaries True to wrap neighbor search around the world edges.
+   */
+  void set_periodic_boundaries(bool periodic_boundaries);
+
+  /** Reorder boids in memory along a Z-order curve now, see BoidStore::sort_spatially(). */
+  void sort_spatially();
+
+  NeighborSearch neighbor_search() const;
+  void set_neighbor_search(NeighborSearch neighbor_search);
+
+  float verlet_skin() const;
+
+  /**
+   * Set skin margin of Verlet lists.
+   *
+   * A larger skin means longer lists but fewer rebuilds.
+   *
+   * \param skin Skin margin added to the cohesion distance.
+   */
+  void set_verlet_skin(float skin);
+
+  unsigned int quadtree_bucket_size() const;
+
+  /**
+   * Set most boids in a quadtree leaf.
+   *
+   * \param bucket_size Leaf size, see Quadtree::set_bucket_size().
+   */
+  void set_quadtree_bucket_size(unsigned int bucket_size);
+
+  int aggregate_grid_subdivisions() const;
+
+  /**
+   * Set cells per cohesion distance of the aggregate grid.
+   *
+   * \param subdivisions Cells per cohesion distance, see AggregateGrid::set_subdivisions().
+   */
+  void set_aggregate_grid_subdivisions(int subdivisions);
+
+  /** Number of Verlet list builds so far */
+  std::size_t verlet_build_count() const;
+
+  unsigned int spatial_sort_interval() const;
+
+  /**
+   * Reorder boids in memory along a Z-order curve every few updates, see BoidStore::sort_spatially().
+   *
+   * A new interval starts counting from zero, set it before loading a
+   * snapshot to sort at the same updates as the saved run.
+   *
+   * \param interval Updates between reorders, zero never reorders.
+   */
+  void set_spatial_sort_interval(unsigned int interval);
+
+  unsigned int topological_neighbor_count() const;
+
+  /**
+   * Let boids follow only their k nearest flockmates, see BoidStore::set_topological_neighbor_count().
+   *
+   * \param count Number of nearest flockmates, zero follows every flockmate within the rule distances.
+   */
+  void set_topological_neighbor_count(unsigned int count);
+
+  std::uint64_t seed() const;
+
+  /**
+   * Set seed of all random numbers of the simulation, picked from std::random_device by default.
+   *
+   * Restarts the stream of new boid positions, rotations and colors. Two
+   * simulations seeded the same before adding boids and stepped with the
+   * same inputs stay equal bit for bit, whatever their thread counts.
+   *
+   * \param seed Seed.
+   */
+  void set_seed(std::uint64_t seed);
+
+  /**
+   * Time the phases of every update, see ProfilePhase.
+   *
+   * The phases inside the boid update are timed on a sample of the boids and
+   * scaled up to the flock size, summed over all threads. Does nothing unless
+   * built with BOIDS_PROFILING.
+   *
+   * \param profiler Profiler, must outlive the simulation or be unset, null stops timing.
+   */
+  void set_profiler(Profiler* profiler);
+
+  /**
+   * Save flock, predators, world size and random state to a snapshot file, see snapshot.h.
+   *
+   * Settings that do not change while the simulation runs, like the thread
+   * count or the neighbor search, are not saved.
+   *
+   * \param path File path.
+   * \param predators Predators.
+   * \throws std::runtime_error If the file cannot be written.
+   */
+  void save_snapshot(const std::string& path, const Predators& predators) const;
+
+  /**
+   * Replace flock, predators, world size and random state with a snapshot saved by save_snapshot().
+   *
+   * Stepping on from a loaded snapshot gives the same result as stepping on
+   * from the moment it was saved.
+   *
+   * \param path File path.
+   * \param predators Predators, replaced with the saved ones.
+   * \throws std::runtime_error If the file cannot be read or is damaged, nothing is changed then.
+   */
+  void load_snapshot(const std::string& path, Predators& predators);
+
+  /** Give every boid a random position, rotation and color. */
+  void randomize_boids();
+
+  /**
+   * Add randomized boids.
+   *
+   * \param count Number of boids to add.
+   */
+  void add_boids(unsigned int count);
+
+  /**
+   * Remove the most recently added boids, at least one boid is always kept.
+   *
+   * \param count Number of boids to remove.
+   */
+  void remove_boids(unsigned int count);
+
+  /**
+   * Remove one boid, the last boid takes its index.
+   *
+   * \param handle Boid handle, see Boid::handle().
+   * \return False if the boid was already removed.
+   */
+  bool remove_boid(const BoidHandle& handle);
+
+  /**
+   * Add autonomous predators at random positions, heading in random directions.
+   *
+   * \param predators Predators, added to.
+   * \param count Number of predators to add.
+   */
+  void add_predators(Predators& predators, unsigned int count);
+
+  /**
+   * Step simulation.
+   *
+   * Autonomous predators chase the flocks around them first, then boids
+   * flee from all predators.
+   *
+   * \param predators Predators, autonomous ones are moved.
+   * \param predator_count Number of predators.
+   * \param dt Delta time in seconds.
+   */
+  void update(Predator* predators, std::size_t predator_count, float dt);
+
+  /**
+   * Step simulation with a predator list, see update() above.
+   *
+   * \param predators Predators, autonomous ones are moved.
+   * \param dt Delta time in seconds.
+   */
+  void update(Predators& predators, float dt);
+
+ private:
+  void randomize_boid(Boids::size_type index);
+
+  /**
+   * Move autonomous predators and index all predators for the boids.
+   *
+   * \param predators Predators.
+   * \param predator_count Number of predators.
+   * \param dt Delta time in seconds.
+   */
+  void update_predators(Predator* predators, std::size_t predator_count, float dt);
+
+  /** Call after anything that moves boids to other indices or teleports them */
+  void invalidate_neighbors();
+
+  /** Grid cell size needed by the neighbor search */
+  float grid_cell_size() const;
+
+  sf::Vector2f world_size_;
+  Boids boids_;
+  Grid grid_;
+  ThreadPool thread_pool_;
+  NeighborSearch neighbor_search_ = NeighborSearch::kGrid;
+  NeighborList neighbor_list_;
+  Quadtree quadtree_;
+  AggregateGrid aggregate_grid_;
+  FlockCenters flock_centers_;
+  PredatorIndex predator_index_;
+  /** Boid headings for the aggregate grid */
+  std::vector<float> heading_sin_;
+  std::vector<float> heading_cos_;
+  unsigned int spatial_sort_interval_ = 0;
+  unsigned int updates_since_spatial_sort_ = 0;
+  /** Boids randomized since the seed was set, counter of their random stream */
+  std::uint64_t randomized_count_ = 0;
+  Profiler* profiler_ = nullptr;
+};
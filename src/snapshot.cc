@@ -0,0 +1,77 @@
+#include "snapshot.h"
+
+#include <stdexcept>
+
+namespace {
+
+const char kMagic[8] = {'B', 'O', 'I', 'D', 'S', 'N', 'A', 'P'};
+/** Reads back in another order on machines with another byte order */
+constexpr std::uint32_t kByteOrderMark = 0x01020304;
+
+}
+
+SnapshotWriter::SnapshotWriter(const std::string& path)
+  : path_(path),
+    file_(path, std::ios::binary | std::ios::trunc) {
+  if (!file_) {
+    throw std::runtime_error("Cannot create snapshot " + path_);
+  }
+
+  write(kMagic, sizeof(kMagic));
+  (*this)(kSnapshotVersion);
+  (*this)(kByteOrderMark);
+}
+
+void SnapshotWriter::close() {
+  file_.close();
+  if (!file_) {
+    throw std::runtime_error("Cannot write snapshot " + path_);
+  }
+}
+
+void SnapshotWriter::write(const void* data, std::size_t size) {
+  file_.write(static_cast<const char*>(data), size);
+  offset_ += size;
+}
+
+void SnapshotWriter::pad(std::size_t alignment) {
+  static const char kZeros[kArrayAlignment] = {};
+  write(kZeros, (alignment - offset_ % alignment) % alignment);
+}
+
+SnapshotReader::SnapshotReader(const std::string& path)
+  : path_(path),
+    file_(path) {
+  if (file_.size() < sizeof(kMagic) || std::memcmp(read(sizeof(kMagic)), kMagic, sizeof(kMagic)) != 0) {
+    fail("not a snapshot");
+  }
+
+  std::uint32_t version = 0;
+  std::uint32_t byte_order_mark = 0;
+  (*this)(version);
+  (*this)(byte_order_mark);
+  if (byte_order_mark != kByteOrderMark) {
+    fail("written on a machine with another byte order");
+  }
+  if (version != kSnapshotVersion) {
+    fail("version " + std::to_string(version) + ", expected " + std::to_string(kSnapshotVersion));
+  }
+}
+
+const unsigned char* SnapshotReader::read(std::size_t size) {
+  if (size > file_.size() - offset_) {
+    fail("unexpected end of file");
+  }
+
+  const unsigned char* data = file_.data() + offset_;
+  offset_ += size;
+  return data;
+}
+
+void SnapshotReader::skip_padding(std::size_t alignment) {
+  read((alignment - offset_ % alignment) % alignment);
+}
+
+void SnapshotReader::fail(const std::string& reason) const {
+  throw std::runtime_error("Cannot load snapshot " + path_ + ": " + reason);
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "mapped_file.h"
+
+/**
+ * Binary snapshots.
+ *
+ * A snapshot file is a header followed by scalars and arrays in native byte
+ * order, in the order the saving code writes them. Every array starts at a
+ * 64 byte offset, so a reader maps the file and copies each array with a
+ * single memcpy, nothing is parsed per element. Readers reject files with
+ * another version or byte order.
+ */
+
+/** Version of the snapshot layout, bump whenever the written fields change */
+constexpr std::uint32_t kSnapshotVersion = 2;
+
+/** Writes a snapshot file, values are written by calling the writer with them. */
+class SnapshotWriter {
+ public:
+  /**
+   * Create file and write the header.
+   *
+   * \param path File path.
+   * \throws std::runtime_error If the file cannot be created.
+   */
+  explicit SnapshotWriter(const std::string& path);
+
+  template<class T>
+  void operator()(const T& value) {
+    static_assert(std::is_trivially_copyable<T>::value, "snapshot values are copied bytewise");
+    pad(alignof(T));
+    write(&value, sizeof(T));
+  }
+
+  template<class T>
+  void operator()(const std::vector<T>& values) {
+    static_assert(std::is_trivially_copyable<T>::value, "snapshot values are copied bytewise");
+    (*this)(static_cast<std::uint64_t>(values.size()));
+    (*this)(static_cast<std::uint64_t>(sizeof(T)));
+    pad(kArrayAlignment);
+    write(values.data(), values.size() * sizeof(T));
+  }
+
+  /**
+   * Flush file.
+   *
+   * \throws std::runtime_error If anything could not be written.
+   */
+  void close();
+
+  static constexpr std::size_t kArrayAlignment = 64;
+
+ private:
+  void write(const void* data, std::size_t size);
+
+  /** Write zeros up to the next multiple of alignment */
+  void pad(std::size_t alignment);
+
+  std::string path_;
+  std::ofstream file_;
+  std::size_t offset_ = 0;
+};
+
+/** Reads a snapshot file, values are read by calling the reader with them in the order they were written. */
+class SnapshotReader {
+ public:
+  /**
+   * Map file and check the header, the arrays are copied out of the mapping when they are read.
+   *
+   * \param path File path.
+   * \throws std::runtime_error If the file cannot be read or is not a snapshot of this version.
+   */
+  explicit SnapshotReader(const std::string& path);
+
+  /** \throws std::runtime_error If the file ends early. */
+  template<class T>
+  void operator()(T& value) {
+    static_assert(std::is_trivially_copyable<T>::value, "snapshot values are copied bytewise");
+    skip_padding(alignof(T));
+    std::memcpy(&value, read(sizeof(T)), sizeof(T));
+  }
+
+  /** \throws std::runtime_error If the file ends early or the array holds another type. */
+  template<class T>
+  void operator()(std::vector<T>& values) {
+    static_assert(std::is_trivially_copyable<T>::value, "snapshot values are copied bytewise");
+    std::uint64_t count = 0;
+    std::uint64_t element_size = 0;
+    (*this)(count);
+    (*this)(element_size);
+    if (element_size != sizeof(T) || count > (file_.size() - offset_) / sizeof(T)) {
+      fail("array does not fit");
+    }
+
+    skip_padding(SnapshotWriter::kArrayAlignment);
+    values.resize(count);
+    std::memcpy(values.data(), read(count * sizeof(T)), count * sizeof(T));
+  }
+
+ private:
+  /** Take the next size bytes of the file */
+  const unsigned char* read(std::size_t size);
+  void skip_padding(std::size_t alignment);
+
+  [[noreturn]] void fail(const std::string& reason) const;
+
+  std::string path_;
+  MappedFile file_;
+  std::size_t offset_ = 0;
+};
@@ -0,0 +1,64 @@
+#include "spatial_order.h"
+
+#include <algorithm>
+#include <array>
+
+namespace {
+
+/** Spread the low 16 bits of value to the even bits */
+std::uint32_t part_1_by_1(std::uint32_t value) {
+  value &= 0x0000ffff;
+  value = (value | (value << 8)) & 0x00ff00ff;
+  value = (value | (value << 4)) & 0x0f0f0f0f;
+  value = (value | (value << 2)) & 0x33333333;
+  value = (value | (value << 1)) & 0x55555555;
+  return value;
+}
+
+std::uint32_t quantize(float coordinate, float size) {
+  const float kScaled = size > 0 ? coordinate / size * 65536 : 0;
+  return static_cast<std::uint32_t>(std::min(std::max(kScaled, 0.0f), 65535.0f));
+}
+
+}
+
+std::uint32_t morton_key(const sf::Vector2f& position, const sf::Vector2f& world_size) {
+  return part_1_by_1(quantize(position.x, world_size.x)) | (part_1_by_1(quantize(position.y, world_size.y)) << 1);
+}
+
+void sort_morton_keys(std::vector<std::uint64_t>& keys, std::vector<std::uint64_t>& scratch) {
+  scratch.resize(keys.size());
+  /** LSD radix sort, one byte of the key per pass */
+  for (int shift = 32; shift < 64; shift += 8) {
+    std::array<std::size_t, 257> offsets = {};
+    for (const std::uint64_t kKey : keys) {
+      ++offsets[((kKey >> shift) & 0xff) + 1];
+    }
+
+    for (std::size_t digit = 1; digit < offsets.size(); ++digit) {
+      offsets[digit] += offsets[digit - 1];
+    }
+
+    for (const std::uint64_t kKey : keys) {
+      scratch[offsets[(kKey >> shift) & 0xff]++] = kKey;
+    }
+    keys.swap(scratch);
+  }
+}
+
+void morton_order(const std::vector<float>& x, const std::vector<float>& y, const sf::Vector2f& world_size,
+                  std::vector<std::uint32_t>& order, std::vector<std::uint64_t>& keys,
+                  std::vector<std::uint64_t>& scratch) {
+  /** Key in the upper and index in the lower half, so only the upper half has to be sorted */
+  keys.resize(x.size());
+  for (std::size_t i = 0; i < x.size(); ++i) {
+    keys[i] = (std::uint64_t(morton_key(sf::Vector2f(x[i], y[i]), world_size)) << 32) | i;
+  }
+
+  sort_morton_keys(keys, scratch);
+
+  order.resize(x.size());
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    order[i] = static_cast<std::uint32_t>(keys[i]);
+  }
+}
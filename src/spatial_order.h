@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <SFML/System/Vector2.hpp>
+
+/**
+ * Get Z-order (Morton) key of a position.
+ *
+ * Coordinates are quantized to 16 bits each and their bits interleaved, so
+ * positions close in space mostly get keys close to each other.
+ *
+ * \param position Position, clamped to the world.
+ * \param world_size World size.
+ * \return Morton key, x in the even and y in the odd bits.
+ */
+std::uint32_t morton_key(const sf::Vector2f& position, const sf::Vector2f& world_size);
+
+/**
+ * Sort keys by their upper 32 bits.
+ *
+ * Radix sort, keys with equal upper halves keep their order.
+ *
+ * \param keys Keys, a Morton key in the upper half and a payload in the lower half.
+ * \param scratch Scratch buffer, reused between calls.
+ */
+void sort_morton_keys(std::vector<std::uint64_t>& keys, std::vector<std::uint64_t>& scratch);
+
+/**
+ * Get order of positions along the Z-order curve.
+ *
+ * Radix sorts the Morton keys, positions with equal keys keep their order.
+ *
+ * \param x X coordinates.
+ * \param y Y coordinates.
+ * \param world_size World size.
+ * \param order Receives position indices in curve order.
+ * \param keys Scratch buffer, reused between calls.
+ * \param scratch Scratch buffer, reused between calls.
+ */
+void morton_order(const std::vector<float>& x, const std::vector<float>& y, const sf::Vector2f& world_size,
+                  std::vector<std::uint32_t>& order, std::vector<std::uint64_t>& keys,
+                  std::vector<std::uint64_t>& scratch);
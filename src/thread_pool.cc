@@ -0,0 +1,212 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace {
+
+std::uint64_t pack_chunks(std::uint32_t first, std::uint32_t end) {
+  return static_cast<std::uint64_t>(end) << 32 | first;
+}
+
+}
+
+constexpr std::size_t ThreadPool::kChunksPerThread;
+
+ThreadPool::ThreadPool(unsigned int thread_count)
+  : workers_(thread_count == 0 ? std::max(1u, std::thread::hardware_concurrency()) : thread_count) {
+  /** The calling thread is a worker too */
+  threads_.reserve(workers_.size() - 1);
+  for (unsigned int i = 0; i + 1 < workers_.size(); ++i) {
+    threads_.emplace_back(&ThreadPool::worker_loop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  job_ready_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+unsigned int ThreadPool::thread_count() const {
+  return workers_.size();
+}
+
+void ThreadPool::parallel_for(std::size_t count, const RangeJob& job, std::size_t chunk_size) {
+  if (count == 0) {
+    return;
+  }
+
+#ifdef BOIDS_PROFILING
+  const Clock::time_point kStart = Clock::now();
+#endif
+  if (chunk_size == 0) {
+    const std::size_t kChunks = workers_.size() * kChunksPerThread;
+    chunk_size = (count + kChunks - 1) / kChunks;
+  }
+  const std::size_t kChunkCount = (count + chunk_size - 1) / chunk_size;
+
+  if (threads_.empty() || kChunkCount == 1) {
+    job_ = &job;
+    job_count_ = count;
+    chunk_size_ = count;
+    run_chunk(workers_.back(), 0);
+  } else {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      job_ = &job;
+      job_count_ = count;
+      chunk_size_ = chunk_size;
+      /** Contiguous blocks, so threads that are not robbed work on neighboring boids like with static chunks */
+      for (std::size_t i = 0; i < workers_.size(); ++i) {
+        const std::size_t kFirst = kChunkCount * i / workers_.size();
+        const std::size_t kEnd = kChunkCount * (i + 1) / workers_.size();
+        workers_[i].chunks.store(pack_chunks(kFirst, kEnd), std::memory_order_relaxed);
+      }
+      pending_workers_ = threads_.size();
+      ++job_generation_;
+    }
+    job_ready_.notify_all();
+
+    work(workers_.size() - 1);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    job_done_.wait(lock, [&] { return pending_workers_ == 0; });
+  }
+  job_ = nullptr;
+
+  ++finished_job_count_;
+#ifdef BOIDS_PROFILING
+  job_time_ += Clock::now() - kStart;
+#endif
+}
+
+ThreadPool::Stats ThreadPool::take_stats() {
+  Stats stats;
+  stats.job_count = finished_job_count_;
+  stats.job_time = job_time_;
+  stats.workers.reserve(workers_.size());
+  for (auto& worker : workers_) {
+    stats.workers.push_back(worker.stats);
+    worker.stats = WorkerStats();
+  }
+  finished_job_count_ = 0;
+  job_time_ = Clock::duration::zero();
+  return stats;
+}
+
+void ThreadPool::worker_loop(unsigned int worker_index) {
+  unsigned long last_generation = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      job_ready_.wait(lock, [&] { return stop_ || job_generation_ != last_generation; });
+      if (stop_) {
+        return;
+      }
+      last_generation = job_generation_;
+    }
+
+    work(worker_index);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      --pending_workers_;
+    }
+    job_done_.notify_one();
+  }
+}
+
+void ThreadPool::work(unsigned int worker_index) {
+  Worker& worker = workers_[worker_index];
+  while (true) {
+    std::uint32_t chunk;
+    if (pop_front(worker, chunk)) {
+      run_chunk(worker, chunk);
+      continue;
+    }
+
+    /** Start at the next thread, so thieves spread over the victims */
+    bool stole = false;
+    for (std::size_t i = 1; i < workers_.size() && !stole; ++i) {
+      std::uint32_t first;
+      std::uint32_t end;
+      if (steal_back(workers_[(worker_index + i) % workers_.size()], first, end)) {
+        /** Only the owner refills an empty deque, so a plain store cannot lose chunks */
+        worker.chunks.store(pack_chunks(first + 1, end), std::memory_order_release);
+        ++worker.stats.steal_count;
+        run_chunk(worker, first);
+        stole = true;
+      }
+    }
+
+    /** Chunks being moved by a thief are run by the thief */
+    if (!stole) {
+      return;
+    }
+  }
+}
+
+bool ThreadPool::pop_front(Worker& worker, std::uint32_t& chunk) {
+  std::uint64_t chunks = worker.chunks.load(std::memory_order_acquire);
+  while (true) {
+    const std::uint32_t kFirst = static_cast<std::uint32_t>(chunks);
+    const std::uint32_t kEnd = static_cast<std::uint32_t>(chunks >> 32);
+    if (kFirst >= kEnd) {
+      return false;
+    }
+
+    if (worker.chunks.compare_exchange_weak(chunks, pack_chunks(kFirst + 1, kEnd), std::memory_order_acq_rel,
+                                            std::memory_order_acquire)) {
+      chunk = kFirst;
+      return true;
+    }
+  }
+}
+
+bool ThreadPool::steal_back(Worker& victim, std::uint32_t& first, std::uint32_t& end) {
+  std::uint64_t chunks = victim.chunks.load(std::memory_order_acquire);
+  while (true) {
+    const std::uint32_t kFirst = static_cast<std::uint32_t>(chunks);
+    const std::uint32_t kEnd = static_cast<std::uint32_t>(chunks >> 32);
+    if (kFirst >= kEnd) {
+      return false;
+    }
+
+    /**
+     * The deque is its whole state, so a compare exchange that succeeds on a
+     * deque emptied and refilled in between still takes chunks nobody else has.
+     */
+    const std::uint32_t kSplit = kEnd - (kEnd - kFirst + 1) / 2;
+    if (victim.chunks.compare_exchange_weak(chunks, pack_chunks(kFirst, kSplit), std::memory_order_acq_rel,
+                                            std::memory_order_acquire)) {
+      first = kSplit;
+      end = kEnd;
+      return true;
+    }
+  }
+}
+
+void ThreadPool::run_chunk(Worker& worker, std::uint32_t chunk) {
+#ifdef BOIDS_PROFILING
+  const Clock::time_point kStart = Clock::now();
+#endif
+  const std::size_t kBegin = chunk * chunk_size_;
+  (*job_)(kBegin, std::min(job_count_, kBegin + chunk_size_));
+  ++worker.stats.chunk_count;
+#ifdef BOIDS_PROFILING
+  worker.stats.busy_time += Clock::now() - kStart;
+#endif
+}
+
+void parallel_for(ThreadPool* thread_pool, std::size_t count, const ThreadPool::RangeJob& job) {
+  if (thread_pool != nullptr) {
+    thread_pool->parallel_for(count, job);
+  } else if (count > 0) {
+    job(0, count);
+  }
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed size pool of worker threads with work stealing.
+ *
+ * Threads are started once and sleep between jobs, so splitting every frame
+ * across the pool does not pay for thread creation.
+ *
+ * A job is cut into chunks, and every thread gets a contiguous block of them
+ * in its own deque. Threads take chunks from the front of their deque, and a
+ * thread whose deque ran dry steals the back half of another deque. Per-boid
+ * work varies a lot with the local density, so a thread that got the dense
+ * part of a flock is helped out instead of holding up the whole job, while
+ * threads with even work stay on their own contiguous boids.
+ */
+class ThreadPool {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  /** Range job, called with [begin, end) */
+  using RangeJob = std::function<void(std::size_t, std::size_t)>;
+
+  /** Chunks per thread when parallel_for() picks the chunk size */
+  static constexpr std::size_t kChunksPerThread = 8;
+
+  /** Work of one thread since the last take_stats() */
+  struct WorkerStats {
+    /** Time spent running chunks, only measured with BOIDS_PROFILING */
+    Clock::duration busy_time = Clock::duration::zero();
+    std::uint64_t chunk_count = 0;
+    /** Times the thread took chunks from another deque */
+    std::uint64_t steal_count = 0;
+  };
+
+  /** Work of the pool since the last take_stats() */
+  struct Stats {
+    std::uint64_t job_count = 0;
+    /** Wall time from starting to finishing all jobs, only measured with BOIDS_PROFILING */
+    Clock::duration job_time = Clock::duration::zero();
+    /** One per thread, the calling thread last */
+    std::vector<WorkerStats> workers;
+  };
+
+  /**
+   * Create thread pool.
+   *
+   * \param thread_count Number of threads working on a job, calling thread included.
+   *                     Zero picks the number of hardware threads.
+   */
+  explicit ThreadPool(unsigned int thread_count = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  unsigned int thread_count() const;
+
+  /**
+   * Run job over [0, count) and wait for it to finish.
+   *
+   * The calling thread works on the job too. Jobs must not start other jobs
+   * on the same pool.
+   *
+   * \param count Range size.
+   * \param job Job, called with chunks of the range from any of the threads.
+   * \param chunk_size Most elements per chunk, zero picks kChunksPerThread chunks per thread.
+   */
+  void parallel_for(std::size_t count, const RangeJob& job, std::size_t chunk_size = 0);
+
+  /** Get work done since the last call and start counting from zero, call between jobs. */
+  Stats take_stats();
+
+ private:
+  struct Worker {
+    /** Chunks left, first in the lower and end in the upper 32 bits */
+    std::atomic<std::uint64_t> chunks{0};
+    WorkerStats stats;
+    /** Keeps the deques of different threads off each other's cache lines */
+    char padding[64];
+  };
+
+  void worker_loop(unsigned int worker_index);
+
+  /** Run chunks of the current job until no deque has any left */
+  void work(unsigned int worker_index);
+
+  /**
+   * Take the first chunk of a deque.
+   *
+   * \param worker Owner of the deque.
+   * \param chunk Chunk index, set on success.
+   * \return False if the deque is empty.
+   */
+  static bool pop_front(Worker& worker, std::uint32_t& chunk);
+
+  /**
+   * Take the back half of a deque, rounded up.
+   *
+   * \param victim Deque owner.
+   * \param first First stolen chunk, set on success.
+   * \param end Chunk after the last stolen one, set on success.
+   * \return False if the deque is empty.
+   */
+  static bool steal_back(Worker& victim, std::uint32_t& first, std::uint32_t& end);
+
+  void run_chunk(Worker& worker, std::uint32_t chunk);
+
+  std::vector<std::thread> threads_;
+  /** One per thread, the calling thread last */
+  std::vector<Worker> workers_;
+  std::mutex mutex_;
+  std::condition_variable job_ready_;
+  std::condition_variable job_done_;
+  const RangeJob* job_ = nullptr;
+  std::size_t job_count_ = 0;
+  std::size_t chunk_size_ = 1;
+  /** Incremented for every job so workers can tell a new job from a spurious wake up */
+  unsigned long job_generation_ = 0;
+  unsigned int pending_workers_ = 0;
+  bool stop_ = false;
+  std::uint64_t finished_job_count_ = 0;
+  Clock::duration job_time_ = Clock::duration::zero();
+};
+
+/**
+ * Run job over [0, count) on a thread pool, or all at once on the calling thread without one.
+ *
+ * \param thread_pool Thread pool, may be null.
+ * \param count Range size.
+ * \param job Job.
+ */
+void parallel_for(ThreadPool* thread_pool, std::size_t count, const ThreadPool::RangeJob& job);
@@ -0,0 +1,382 @@
+#include "trajectory.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+const char kMagic[8] = {'B', 'O', 'I', 'D', 'T', 'R', 'A', 'J'};
+constexpr std::uint32_t kByteOrderMark = 0x01020304;
+/** Magic, version, byte order mark, dt and keyframe interval */
+constexpr std::size_t kHeaderSize = 24;
+/** First frame, frame count, boid count, world size and data size */
+constexpr std::size_t kChunkHeaderSize = 32;
+/** x, y and rotation */
+constexpr std::size_t kValuesPerBoid = 3;
+constexpr float kQuantizationSteps = 65536;
+
+template<class T>
+void append(std::vector<unsigned char>& bytes, const T& value) {
+  const unsigned char* kBytes = reinterpret_cast<const unsigned char*>(&value);
+  bytes.insert(bytes.end(), kBytes, kBytes + sizeof(T));
+}
+
+template<class T>
+T load(const unsigned char* bytes) {
+  T value;
+  std::memcpy(&value, bytes, sizeof(T));
+  return value;
+}
+
+/** Fraction of range as 16 bits, a full range wraps to 0 */
+std::uint16_t quantize(float value, float range) {
+  return static_cast<std::uint16_t>(static_cast<std::int32_t>(value * (kQuantizationSteps / range)) & 0xffff);
+}
+
+/** Center of the quantization step */
+float dequantize(std::uint16_t value, float range) {
+  return (value + 0.5f) * (range / kQuantizationSteps);
+}
+
+/** Small differences of either sign become small unsigned numbers */
+std::uint16_t zigzag(std::uint16_t delta) {
+  const std::uint16_t kSign = static_cast<std::int16_t>(delta) < 0 ? 0xffff : 0;
+  return static_cast<std::uint16_t>((delta << 1) ^ kSign);
+}
+
+std::uint16_t unzigzag(std::uint16_t value) {
+  return static_cast<std::uint16_t>((value >> 1) ^ -(value & 1));
+}
+
+[[noreturn]] void fail(const std::string& reason) {
+  throw std::runtime_error("Cannot read trajectory: " + reason);
+}
+
+}
+
+TrajectoryRecorder::TrajectoryRecorder(const std::string& path, float dt, unsigned int keyframe_interval,
+                                       unsigned int max_queued_frames)
+  : file_(path, std::ios::binary | std::ios::trunc),
+    kPath_(path),
+    kKeyframeInterval_(std::max(1u, keyframe_interval)),
+    kMaxQueuedFrames_(std::max(1u, max_queued_frames)),
+    bytes_written_(0),
+    write_failed_(false) {
+  if (!file_) {
+    throw std::runtime_error("Cannot create trajectory " + path);
+  }
+
+  std::vector<unsigned char> header(kMagic, kMagic + sizeof(kMagic));
+  append(header, kTrajectoryVersion);
+  append(header, kByteOrderMark);
+  append(header, dt);
+  append(header, static_cast<std::uint32_t>(kKeyframeInterval_));
+  file_.write(reinterpret_cast<const char*>(header.data()), header.size());
+  if (!file_) {
+    throw std::runtime_error("Cannot write trajectory " + path);
+  }
+  bytes_written_ = header.size();
+
+  writer_ = std::thread(&TrajectoryRecorder::writer_loop, this);
+}
+
+TrajectoryRecorder::~TrajectoryRecorder() {
+  try {
+    close();
+  } catch (const std::runtime_error&) {
+    /** Destructors must not throw, callers that care close() first */
+  }
+}
+
+void TrajectoryRecorder::close() {
+  if (!writer_.joinable()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  frame_ready_.notify_one();
+  writer_.join();
+  if (write_failed_) {
+    throw std::runtime_error("Cannot write trajectory " + kPath_ + ", the recording is incomplete");
+  }
+}
+
+void TrajectoryRecorder::record(const BoidStore& boids, const sf::Vector2f& world_size, ThreadPool* thread_pool) {
+  const std::uint64_t kIndex = frame_count_++;
+  std::vector<std::uint16_t> values;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (queue_.size() >= kMaxQueuedFrames_ || write_failed_) {
+      ++dropped_frame_count_;
+      return;
+    }
+
+    if (!free_buffers_.empty()) {
+      values.swap(free_buffers_.back());
+      free_buffers_.pop_back();
+    }
+  }
+
+  const std::size_t kCount = boids.size();
+  values.resize(kCount * kValuesPerBoid);
+  parallel_for(thread_pool, kCount, [&](std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i) {
+      values[i] = quantize(boids.x()[i], world_size.x);
+      values[kCount + i] = quantize(boids.y()[i], world_size.y);
+      values[2 * kCount + i] = quantize(boids.rotation(i), 360);
+    }
+  });
+  boid_frame_count_ += kCount;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(QueuedFrame{kIndex, world_size, static_cast<std::uint32_t>(kCount), std::move(values)});
+  }
+  frame_ready_.notify_one();
+}
+
+TrajectoryRecorder::Stats TrajectoryRecorder::stats() const {
+  Stats stats;
+  stats.frame_count = frame_count_;
+  stats.dropped_frame_count = dropped_frame_count_;
+  stats.boid_frame_count = boid_frame_count_;
+  stats.bytes_written = bytes_written_;
+  stats.write_failed = write_failed_;
+  return stats;
+}
+
+void TrajectoryRecorder::writer_loop() {
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      frame_ready_.wait(lock, [&] { return stop_ || !queue_.empty(); });
+      /** Queued frames are written before stopping */
+      if (queue_.empty()) {
+        break;
+      }
+      writing_.swap(queue_);
+    }
+
+    for (QueuedFrame& frame : writing_) {
+      encode(frame);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (QueuedFrame& frame : writing_) {
+        free_buffers_.push_back(std::move(frame.values));
+      }
+    }
+    writing_.clear();
+  }
+
+  flush_chunk();
+  file_.close();
+  if (!file_) {
+    write_failed_ = true;
+  }
+}
+
+void TrajectoryRecorder::encode(QueuedFrame& frame) {
+  /** Predictions only make sense from the directly preceding frames of the same boids in the same world */
+  const bool kKeyframe = chunk_frame_count_ == 0 || chunk_frame_count_ >= kKeyframeInterval_ ||
+                         frame.index != previous_.index + 1 || frame.boid_count != previous_.boid_count ||
+                         frame.world_size != previous_.world_size;
+  if (kKeyframe) {
+    flush_chunk();
+    chunk_first_frame_ = frame.index;
+    const unsigned char* kBytes = reinterpret_cast<const unsigned char*>(frame.values.data());
+    chunk_.insert(chunk_.end(), kBytes, kBytes + frame.values.size() * sizeof(std::uint16_t));
+  } else {
+    const bool kLinear = chunk_frame_count_ >= 2;
+    for (std::size_t i = 0; i < frame.values.size(); ++i) {
+      const std::uint16_t kPrediction =
+        kLinear ? static_cast<std::uint16_t>(2 * previous_.values[i] - before_previous_values_[i]) : previous_.values[i];
+      std::uint16_t value = zigzag(static_cast<std::uint16_t>(frame.values[i] - kPrediction));
+      while (value >= 0x80) {
+        chunk_.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+      }
+      chunk_.push_back(static_cast<unsigned char>(value));
+    }
+  }
+
+  ++chunk_frame_count_;
+  /** The oldest buffer goes back to the caller */
+  before_previous_values_.swap(previous_.values);
+  std::swap(previous_, frame);
+}
+
+void TrajectoryRecorder::flush_chunk() {
+  if (chunk_frame_count_ == 0) {
+    return;
+  }
+
+  /** Every frame of a chunk has the boid count and world size of the last one */
+  std::vector<unsigned char> header;
+  header.reserve(kChunkHeaderSize);
+  append(header, chunk_first_frame_);
+  append(header, chunk_frame_count_);
+  append(header, previous_.boid_count);
+  append(header, previous_.world_size.x);
+  append(header, previous_.world_size.y);
+  append(header, static_cast<std::uint64_t>(chunk_.size()));
+  if (!write_failed_) {
+    file_.write(reinterpret_cast<const char*>(header.data()), header.size());
+    file_.write(reinterpret_cast<const char*>(chunk_.data()), chunk_.size());
+    if (file_) {
+      bytes_written_ += header.size() + chunk_.size();
+    } else {
+      write_failed_ = true;
+    }
+  }
+
+  chunk_.clear();
+  chunk_frame_count_ = 0;
+}
+
+TrajectoryReader::TrajectoryReader(const std::string& path)
+  : file_(path) {
+  const unsigned char* kData = file_.data();
+  const std::size_t kSize = file_.size();
+  if (kSize < kHeaderSize || std::memcmp(kData, kMagic, sizeof(kMagic)) != 0) {
+    fail(path + " is not a trajectory");
+  }
+  if (load<std::uint32_t>(kData + 12) != kByteOrderMark) {
+    fail(path + " was written on a machine with another byte order");
+  }
+  const std::uint32_t kVersion = load<std::uint32_t>(kData + 8);
+  if (kVersion != kTrajectoryVersion) {
+    fail(path + " has version " + std::to_string(kVersion) + ", expected " + std::to_string(kTrajectoryVersion));
+  }
+  dt_ = load<float>(kData + 16);
+
+  /** A chunk cut off while recording ends the trajectory */
+  std::size_t offset = kHeaderSize;
+  while (kSize - offset >= kChunkHeaderSize) {
+    const unsigned char* kHeader = kData + offset;
+    Chunk chunk;
+    chunk.first_frame = load<std::uint64_t>(kHeader);
+    chunk.frame_count = load<std::uint32_t>(kHeader + 8);
+    chunk.boid_count = load<std::uint32_t>(kHeader + 12);
+    chunk.world_size = sf::Vector2f(load<float>(kHeader + 16), load<float>(kHeader + 20));
+    const std::uint64_t kDataSize = load<std::uint64_t>(kHeader + 24);
+    offset += kChunkHeaderSize;
+    if (kDataSize > kSize - offset || chunk.frame_count == 0 ||
+        kDataSize < static_cast<std::uint64_t>(chunk.boid_count) * kValuesPerBoid * sizeof(std::uint16_t) ||
+        (!chunks_.empty() && chunk.first_frame < chunks_.back().first_frame + chunks_.back().frame_count)) {
+      break;
+    }
+
+    chunk.begin = kData + offset;
+    chunk.end = chunk.begin + kDataSize;
+    chunks_.push_back(chunk);
+    offset += kDataSize;
+  }
+
+  seek(0);
+}
+
+float TrajectoryReader::dt() const {
+  return dt_;
+}
+
+std::uint64_t TrajectoryReader::end_frame() const {
+  return chunks_.empty() ? 0 : chunks_.back().first_frame + chunks_.back().frame_count;
+}
+
+std::size_t TrajectoryReader::keyframe_count() const {
+  return chunks_.size();
+}
+
+std::uint64_t TrajectoryReader::keyframe_of(std::uint64_t frame) const {
+  const auto kChunk = find_chunk(frame);
+  return kChunk == chunks_.end() ? end_frame() : kChunk->first_frame;
+}
+
+void TrajectoryReader::seek(std::uint64_t frame) {
+  const auto kChunk = find_chunk(frame);
+  chunk_index_ = kChunk - chunks_.begin();
+  frame_in_chunk_ = 0;
+  if (kChunk == chunks_.end()) {
+    return;
+  }
+
+  cursor_ = kChunk->begin;
+  if (frame > kChunk->first_frame) {
+    for (std::uint64_t i = kChunk->first_frame; i < frame; ++i) {
+      decode_next();
+    }
+  }
+}
+
+bool TrajectoryReader::read_frame(TrajectoryFrame& frame) {
+  while (chunk_index_ < chunks_.size() && frame_in_chunk_ == chunks_[chunk_index_].frame_count) {
+    ++chunk_index_;
+    frame_in_chunk_ = 0;
+    if (chunk_index_ < chunks_.size()) {
+      cursor_ = chunks_[chunk_index_].begin;
+    }
+  }
+  if (chunk_index_ == chunks_.size()) {
+    return false;
+  }
+
+  decode_next();
+
+  const Chunk& kChunk = chunks_[chunk_index_];
+  const std::size_t kCount = kChunk.boid_count;
+  frame.index = kChunk.first_frame + frame_in_chunk_ - 1;
+  frame.world_size = kChunk.world_size;
+  frame.x.resize(kCount);
+  frame.y.resize(kCount);
+  frame.rotation.resize(kCount);
+  for (std::size_t i = 0; i < kCount; ++i) {
+    frame.x[i] = dequantize(values_[i], kChunk.world_size.x);
+    frame.y[i] = dequantize(values_[kCount + i], kChunk.world_size.y);
+    frame.rotation[i] = dequantize(values_[2 * kCount + i], 360);
+  }
+  return true;
+}
+
+std::vector<TrajectoryReader::Chunk>::const_iterator TrajectoryReader::find_chunk(std::uint64_t frame) const {
+  return std::upper_bound(chunks_.begin(), chunks_.end(), frame, [](std::uint64_t target, const Chunk& chunk) {
+    return target < chunk.first_frame + chunk.frame_count;
+  });
+}
+
+void TrajectoryReader::decode_next() {
+  const Chunk& kChunk = chunks_[chunk_index_];
+  const std::size_t kValueCount = static_cast<std::size_t>(kChunk.boid_count) * kValuesPerBoid;
+  if (frame_in_chunk_ == 0) {
+    /** Size was checked while indexing */
+    values_.resize(kValueCount);
+    std::memcpy(values_.data(), cursor_, kValueCount * sizeof(std::uint16_t));
+    cursor_ += kValueCount * sizeof(std::uint16_t);
+  } else {
+    const bool kLinear = frame_in_chunk_ >= 2;
+    previous_values_.resize(kValueCount);
+    for (std::size_t i = 0; i < kValueCount; ++i) {
+      std::uint16_t value = 0;
+      for (int shift = 0; ; shift += 7) {
+        if (cursor_ == kChunk.end || shift > 14) {
+          fail("damaged frame " + std::to_string(kChunk.first_frame + frame_in_chunk_));
+        }
+        const unsigned char kByte = *cursor_++;
+        value |= static_cast<std::uint16_t>((kByte & 0x7f) << shift);
+        if ((kByte & 0x80) == 0) {
+          break;
+        }
+      }
+      const std::uint16_t kPrediction =
+        kLinear ? static_cast<std::uint16_t>(2 * values_[i] - previous_values_[i]) : values_[i];
+      previous_values_[i] = values_[i];
+      values_[i] = static_cast<std::uint16_t>(kPrediction + unzigzag(value));
+    }
+  }
+  ++frame_in_chunk_;
+}
@@ -0,0 +1,242 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <SFML/System/Vector2.hpp>
+#include "boid.h"
+#include "mapped_file.h"
+#include "thread_pool.h"
+
+/**
+ * Boid trajectories, the position and heading of every boid in every frame.
+ *
+ * Positions are quantized to 16 bit fractions of the world size and
+ * rotations to 16 bit fractions of a full turn, so wrapping around the world
+ * edges or past 360 degrees is wrapping of the integers. Frames are grouped
+ * into chunks, each starting with a keyframe of plain values. The other
+ * frames hold the difference to a linear prediction from the two frames
+ * before them, or to the keyframe for the second frame, as zigzag varints.
+ * Boids move and turn steadily, so most differences fit in one byte.
+ *
+ * File layout, native byte order:
+ *   header: "BOIDTRAJ", version, byte order mark, dt, keyframe interval
+ *   chunks: first frame, frame count, boid count, world size, data size,
+ *           keyframe x, y and rotation as uint16 arrays, delta frames
+ */
+
+/** Version of the trajectory layout, bump whenever it changes */
+constexpr std::uint32_t kTrajectoryVersion = 1;
+
+/** One decoded frame */
+struct TrajectoryFrame {
+  /** Number of the frame since the recording started */
+  std::uint64_t index = 0;
+  sf::Vector2f world_size;
+  std::vector<float> x;
+  std::vector<float> y;
+  /** Rotation in degrees */
+  std::vector<float> rotation;
+};
+
+/**
+ * Records trajectories to a file.
+ *
+ * record() only quantizes the boids and queues the frame, encoding and
+ * writing run on a background thread. The simulation thread never waits for
+ * the disk: if too many frames are queued the frame is dropped and the next
+ * recorded frame starts a new keyframe.
+ */
+class TrajectoryRecorder {
+ public:
+  /** Recording counters */
+  struct Stats {
+    /** Frames passed to record() */
+    std::uint64_t frame_count = 0;
+    /** Frames dropped because the writer fell behind or failed */
+    std::uint64_t dropped_frame_count = 0;
+    /** Boid positions and headings recorded, for comparing sizes with raw floats */
+    std::uint64_t boid_frame_count = 0;
+    /** Bytes written to the file */
+    std::uint64_t bytes_written = 0;
+    /** True if writing to the file failed, the file ends before the failed chunk */
+    bool write_failed = false;
+  };
+
+  /**
+   * Create file and start the writer thread.
+   *
+   * \param path File path.
+   * \param dt Simulation time step in seconds, stored for replays.
+   * \param keyframe_interval Most frames per chunk, a reader seeks to a frame by decoding up to this many frames.
+   * \param max_queued_frames Frames queued for the writer before record() drops frames.
+   * \throws std::runtime_error If the file cannot be created.
+   */
+  TrajectoryRecorder(const std::string& path, float dt, unsigned int keyframe_interval = 60,
+                     unsigned int max_queued_frames = 8);
+
+  /** Calls close(), a failed write is only reported by calling close() before. */
+  ~TrajectoryRecorder();
+
+  TrajectoryRecorder(const TrajectoryRecorder&) = delete;
+  TrajectoryRecorder& operator=(const TrajectoryRecorder&) = delete;
+
+  /**
+   * Record current state of the boids as the next frame.
+   *
+   * \param boids Boids.
+   * \param world_size World size, boids wrap around at its edges.
+   * \param thread_pool Thread pool to quantize different boids on, null for the calling thread.
+   */
+  void record(const BoidStore& boids, const sf::Vector2f& world_size, ThreadPool* thread_pool = nullptr);
+
+  /**
+   * Write all queued frames and close the file, record() must not be called afterwards.
+   *
+   * \throws std::runtime_error If any write failed, like on a full disk, and the recording is incomplete.
+   */
+  void close();
+
+  /** Counters, call from the recording thread, bytes_written lags behind until close() */
+  Stats stats() const;
+
+ private:
+  /** Quantized frame, x, y and rotation of all boids one after another */
+  struct QueuedFrame {
+    std::uint64_t index = 0;
+    sf::Vector2f world_size;
+    std::uint32_t boid_count = 0;
+    std::vector<std::uint16_t> values;
+  };
+
+  void writer_loop();
+
+  /**
+   * Add frame to the open chunk, or start a new chunk with it as keyframe.
+   *
+   * \param frame Frame, its values are swapped into previous_.
+   */
+  void encode(QueuedFrame& frame);
+
+  /** Write open chunk to the file */
+  void flush_chunk();
+
+  std::ofstream file_;
+  const std::string kPath_;
+  const unsigned int kKeyframeInterval_;
+  const unsigned int kMaxQueuedFrames_;
+
+  std::mutex mutex_;
+  std::condition_variable frame_ready_;
+  std::vector<QueuedFrame> queue_;
+  /** Buffers of written frames, reused so recording does not allocate */
+  std::vector<std::vector<std::uint16_t>> free_buffers_;
+  bool stop_ = false;
+
+  /** Counters of the recording thread */
+  std::uint64_t frame_count_ = 0;
+  std::uint64_t dropped_frame_count_ = 0;
+  std::uint64_t boid_frame_count_ = 0;
+  /** Counter of the writer thread */
+  std::atomic<std::uint64_t> bytes_written_;
+  /** Set by the writer thread once the file is bad, later chunks are not written */
+  std::atomic<bool> write_failed_;
+
+  /** Writer thread state */
+  QueuedFrame previous_;
+  std::vector<std::uint16_t> before_previous_values_;
+  std::uint32_t chunk_frame_count_ = 0;
+  std::uint64_t chunk_first_frame_ = 0;
+  std::vector<unsigned char> chunk_;
+  std::vector<QueuedFrame> writing_;
+
+  std::thread writer_;
+};
+
+/**
+ * Reads trajectories written by TrajectoryRecorder.
+ *
+ * The file is memory mapped and the chunk headers are scanned once, so any
+ * frame can be found without reading the frames before its keyframe. A file
+ * cut off while recording is read up to its last whole chunk.
+ */
+class TrajectoryReader {
+ public:
+  /**
+   * Map file and index its chunks.
+   *
+   * \param path File path.
+   * \throws std::runtime_error If the file cannot be read or is not a trajectory of this version.
+   */
+  explicit TrajectoryReader(const std::string& path);
+
+  /** Simulation time step of the recording in seconds */
+  float dt() const;
+
+  /** Index of the frame after the last recorded one */
+  std::uint64_t end_frame() const;
+
+  /** Number of keyframes, places a seek can start decoding from */
+  std::size_t keyframe_count() const;
+
+  /**
+   * Get keyframe a seek starts decoding from.
+   *
+   * \param frame Frame index.
+   * \return Index of the keyframe at or before the frame, or of the next keyframe if the
+   *         frame was dropped, end_frame() after the last frame.
+   */
+  std::uint64_t keyframe_of(std::uint64_t frame) const;
+
+  /**
+   * Move to a frame.
+   *
+   * Decodes from the keyframe before the frame up to it. If the frame was
+   * dropped while recording the next recorded frame follows.
+   *
+   * \param frame Frame index.
+   */
+  void seek(std::uint64_t frame);
+
+  /**
+   * Decode next frame.
+   *
+   * \param frame Decoded frame.
+   * \return False at the end of the trajectory.
+   * \throws std::runtime_error If the frame data is damaged.
+   */
+  bool read_frame(TrajectoryFrame& frame);
+
+ private:
+  struct Chunk {
+    std::uint64_t first_frame;
+    std::uint32_t frame_count;
+    std::uint32_t boid_count;
+    sf::Vector2f world_size;
+    /** Frame data, right after the chunk header */
+    const unsigned char* begin;
+    const unsigned char* end;
+  };
+
+  /** First chunk that ends after the frame */
+  std::vector<Chunk>::const_iterator find_chunk(std::uint64_t frame) const;
+
+  /** Decode next frame of the current chunk into values_, the frame before goes to previous_values_ */
+  void decode_next();
+
+  MappedFile file_;
+  float dt_ = 0;
+  std::vector<Chunk> chunks_;
+
+  /** Decoder position */
+  std::size_t chunk_index_ = 0;
+  std::uint32_t frame_in_chunk_ = 0;
+  const unsigned char* cursor_ = nullptr;
+  std::vector<std::uint16_t> values_;
+  std::vector<std::uint16_t> previous_values_;
+};
@@ -0,0 +1,110 @@
+#include "trajectory_player.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+TrajectoryPlayer::TrajectoryPlayer(const std::string& path)
+  : reader_(path) {
+  if (reader_.end_frame() == 0) {
+    throw std::runtime_error("Cannot play " + path + ": no whole frames recorded");
+  }
+
+  load_from_reader();
+  position_ = frame_.index;
+}
+
+void TrajectoryPlayer::advance(float seconds) {
+  if (paused_) {
+    return;
+  }
+
+  seek(position_ + seconds * speed_ / reader_.dt());
+  if (position_ >= end_frame() - 1) {
+    paused_ = true;
+  }
+}
+
+void TrajectoryPlayer::seek(double frame) {
+  position_ = std::max(0.0, std::min(frame, static_cast<double>(end_frame() - 1)));
+  sync();
+}
+
+double TrajectoryPlayer::position() const {
+  return position_;
+}
+
+bool TrajectoryPlayer::paused() const {
+  return paused_;
+}
+
+void TrajectoryPlayer::set_paused(bool paused) {
+  paused_ = paused;
+}
+
+float TrajectoryPlayer::speed() const {
+  return speed_;
+}
+
+void TrajectoryPlayer::set_speed(float speed) {
+  speed_ = speed;
+}
+
+const TrajectoryFrame& TrajectoryPlayer::frame() const {
+  return frame_;
+}
+
+const TrajectoryFrame& TrajectoryPlayer::next_frame() const {
+  return has_next_frame_ ? next_frame_ : frame_;
+}
+
+float TrajectoryPlayer::alpha() const {
+  if (!has_next_frame_ || position_ <= frame_.index) {
+    return 0;
+  }
+  return std::min(1.0, (position_ - frame_.index) / (next_frame_.index - frame_.index));
+}
+
+std::uint64_t TrajectoryPlayer::end_frame() const {
+  return reader_.end_frame();
+}
+
+float TrajectoryPlayer::dt() const {
+  return reader_.dt();
+}
+
+std::uint64_t TrajectoryPlayer::decoded_frame_count() const {
+  return decoded_frame_count_;
+}
+
+void TrajectoryPlayer::sync() {
+  const std::uint64_t kTarget = static_cast<std::uint64_t>(std::floor(position_));
+  if (kTarget < frame_.index) {
+    reader_.seek(kTarget);
+    load_from_reader();
+    return;
+  }
+
+  /** Decoding on is only worth it until the keyframe of the target lies ahead of the reader */
+  if (has_next_frame_ && kTarget >= next_frame_.index && reader_.keyframe_of(kTarget) > next_frame_.index) {
+    reader_.seek(kTarget);
+    load_from_reader();
+    return;
+  }
+
+  while (has_next_frame_ && kTarget >= next_frame_.index) {
+    std::swap(frame_, next_frame_);
+    has_next_frame_ = reader_.read_frame(next_frame_);
+    decoded_frame_count_ += has_next_frame_;
+  }
+}
+
+void TrajectoryPlayer::load_from_reader() {
+  /** Seeks never go past the last frame, so there always is one */
+  reader_.read_frame(frame_);
+  has_next_frame_ = reader_.read_frame(next_frame_);
+  decoded_frame_count_ += 1 + has_next_frame_;
+  /** Seeking into frames dropped while recording lands on the next recorded one */
+  position_ = std::max(position_, static_cast<double>(frame_.index));
+}
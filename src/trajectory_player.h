@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "trajectory.h"
+
+/**
+ * Plays back a recorded trajectory, without simulating.
+ *
+ * Keeps the two decoded frames around the playback position, so boids can be
+ * drawn between them at any speed. Moving forward decodes frame after frame
+ * unless a keyframe closer to the target lies ahead, then the frames up to it
+ * are skipped without decoding, which keeps fast playback and scrubbing cheap.
+ */
+class TrajectoryPlayer {
+ public:
+  /**
+   * Open trajectory, playback starts paused at the first frame.
+   *
+   * \param path Trajectory file path.
+   * \throws std::runtime_error If the file cannot be read.
+   */
+  explicit TrajectoryPlayer(const std::string& path);
+
+  /**
+   * Move playback position forward by wall clock time, scaled by the speed.
+   *
+   * Does nothing while paused, pauses at the last frame.
+   *
+   * \param seconds Wall clock time in seconds.
+   */
+  void advance(float seconds);
+
+  /**
+   * Move playback position.
+   *
+   * \param frame Frame index, clamped to the recorded frames.
+   */
+  void seek(double frame);
+
+  /** Playback position in frames, fractional between two frames */
+  double position() const;
+
+  bool paused() const;
+  void set_paused(bool paused);
+
+  float speed() const;
+
+  /**
+   * Set playback speed.
+   *
+   * \param speed Recorded seconds per wall clock second, 1 plays in real time.
+   */
+  void set_speed(float speed);
+
+  /** Recorded frame at or before the playback position */
+  const TrajectoryFrame& frame() const;
+
+  /** Recorded frame after frame(), the same frame at the end */
+  const TrajectoryFrame& next_frame() const;
+
+  /** Fraction of the way from frame() to next_frame() */
+  float alpha() const;
+
+  /** Index of the frame after the last recorded one */
+  std::uint64_t end_frame() const;
+
+  /** Simulation time step of the recording in seconds */
+  float dt() const;
+
+  /** Frames decoded so far, skipped frames are not decoded */
+  std::uint64_t decoded_frame_count() const;
+
+ private:
+  /** Decode the frames around the playback position */
+  void sync();
+
+  /** Decode frame and the frame after it from the reader position */
+  void load_from_reader();
+
+  TrajectoryReader reader_;
+  TrajectoryFrame frame_;
+  TrajectoryFrame next_frame_;
+  bool has_next_frame_ = false;
+  double position_ = 0;
+  bool paused_ = true;
+  float speed_ = 1;
+  std::uint64_t decoded_frame_count_ = 0;
+};
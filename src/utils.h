@@ -1,6 +1,6 @@
 #pragma once
 
-#include <SFML/System.hpp>
+#include <SFML/System/Vector2.hpp>
 #include <cmath>
 
 template<class T>
@@ -30,3 +30,97 @@ T constraint_angle_0_360(T angle) {
   }
   return angle;
 }
+
+/**
+ * Shortest difference vector in a world that wraps around at its edges.
+ *
+ * \param delta Difference of two positions inside the world.
+ * \param world_size World size.
+ */
+template<class T>
+sf::Vector2<T> minimum_image_2d(sf::Vector2<T> delta, const sf::Vector2<T>& world_size) {
+  if (delta.x > world_size.x / 2) {
+    delta.x -= world_size.x;
+  } else if (delta.x < -world_size.x / 2) {
+    delta.x += world_size.x;
+  }
+
+  if (delta.y > world_size.y / 2) {
+    delta.y -= world_size.y;
+  } else if (delta.y < -world_size.y / 2) {
+    delta.y += world_size.y;
+  }
+  return delta;
+}
+
+template<class T>
+T length_2d(const sf::Vector2<T>& v) {
+  return std::sqrt(v.x * v.x + v.y * v.y);
+}
+
+/**
+ * Get (cos, sin) of angle without calling into libm.
+ *
+ * The angle is halved until a short Taylor series is accurate and then doubled
+ * back up, good to about 1e-6 for |angle| <= pi.
+ *
+ * \param angle Angle in radians.
+ */
+template<class T>
+sf::Vector2<T> cos_sin(T angle) {
+  int halvings = 0;
+  while (std::abs(angle) > T(0.25)) {
+    angle /= 2;
+    ++halvings;
+  }
+
+  const T kAngleSquared = angle * angle;
+  T cos = 1 - kAngleSquared / 2 * (1 - kAngleSquared / 12 * (1 - kAngleSquared / 30));
+  T sin = angle * (1 - kAngleSquared / 6 * (1 - kAngleSquared / 20 * (1 - kAngleSquared / 42)));
+  for (; halvings > 0; --halvings) {
+    const T kSin = 2 * sin * cos;
+    cos = 1 - 2 * sin * sin;
+    sin = kSin;
+  }
+  return sf::Vector2<T>(cos, sin);
+}
+
+/**
+ * Rotate vector, positive angles turn clockwise on screen like sf::Transform::rotate.
+ *
+ * \param v Vector.
+ * \param cos_sin Cosine and sine of the angle.
+ */
+template<class T>
+sf::Vector2<T> rotate_2d(const sf::Vector2<T>& v, const sf::Vector2<T>& cos_sin) {
+  return sf::Vector2<T>(v.x * cos_sin.x - v.y * cos_sin.y, v.x * cos_sin.y + v.y * cos_sin.x);
+}
+
+/**
+ * Turn unit vector towards another one by at most max_angle.
+ *
+ * \param from Unit vector to turn.
+ * \param to Unit target vector.
+ * \param max_angle Largest allowed turn in radians.
+ * \return Unit vector, equal to to if it is within reach.
+ */
+template<class T>
+sf::Vector2<T> rotate_towards(const sf::Vector2<T>& from, const sf::Vector2<T>& to, T max_angle) {
+  if (max_angle >= kPi<T>) {
+    return to;
+  }
+
+  sf::Vector2<T> step = cos_sin(max_angle);
+  if (from.x * to.x + from.y * to.y >= step.x) {
+    return to;
+  }
+
+  /** Same as the angle version, turn clockwise unless the target is counterclockwise */
+  if (from.x * to.y - from.y * to.x < 0) {
+    step.y = -step.y;
+  }
+
+  /** Renormalize so rounding errors do not build up over frames */
+  const sf::Vector2<T> kRotated = rotate_2d(from, step);
+  return kRotated / length_2d(kRotated);
+}